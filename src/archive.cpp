@@ -0,0 +1,314 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#include "archive.h"
+#include "encoding.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ALIGN(n) (((n) + 7) & ~7ULL)
+
+/** Header at the start of both the data and the index file */
+struct ArchiveHeader {
+    uint32_t magic;
+    uint32_t version;
+};
+
+/** Orders entries by level, then by decreasing fitness */
+static bool byLevelAndFitness(const ArchiveEntry &a, const ArchiveEntry &b) {
+    if(a.level != b.level) return a.level < b.level;
+    return a.fitness > b.fitness;
+}
+
+static bool byFitness(const ArchiveEntry &a, const ArchiveEntry &b) {
+    return a.fitness > b.fitness;
+}
+
+static bool byLevel(const ArchiveEntry &a, const ArchiveEntry &b) {
+    return a.level < b.level;
+}
+
+/**
+ * Open the given file, writing a header if it is empty or checking the
+ * header otherwise.
+ * 
+ * @param filename  the name of the file
+ * @return          the descriptor, or -1 on failure
+ */
+static int openWithHeader(const char *filename) {
+    int fd = open(filename, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if(fd < 0) {
+        perror(filename);
+        return -1;
+    }
+    ArchiveHeader header;
+    ssize_t n = pread(fd, &header, sizeof(header), 0);
+    if(n == 0) {
+        header.magic = ARCHIVE_MAGIC;
+        header.version = ARCHIVE_VERSION;
+        if(write(fd, &header, sizeof(header)) == sizeof(header)) return fd;
+    } else if(n == sizeof(header) && header.magic == ARCHIVE_MAGIC
+              && header.version == ARCHIVE_VERSION) {
+        return fd;
+    }
+    fprintf(stderr, "%s: not a genome archive\n", filename);
+    close(fd);
+    return -1;
+}
+
+static uint64_t fileSize(int fd) {
+    struct stat st;
+    fstat(fd, &st);
+    return st.st_size;
+}
+
+Archive::Archive()
+    : m_data(-1), m_index(-1), m_dataSize(0), m_map(NULL), m_mapSize(0),
+      m_level(0), m_sorted(false) {}
+
+Archive::~Archive() {
+    if(m_map) munmap(m_map, m_mapSize);
+    if(m_data >= 0) close(m_data);
+    if(m_index >= 0) close(m_index);
+}
+
+/**
+ * Open an archive, creating it if necessary. The index is kept alongside the
+ * data in a file with ".idx" appended to its name.
+ * 
+ * @param filename  the name of the data file
+ * @param level     the name of the level that genomes will be recorded for
+ * @return          true on success
+ */
+bool Archive::open(const char *filename, const char *level) {
+    std::string indexName = std::string(filename) + ".idx";
+    m_level = levelId(level);
+    m_data = openWithHeader(filename);
+    m_index = openWithHeader(indexName.c_str());
+    if(m_data < 0 || m_index < 0) return false;
+    m_dataSize = fileSize(m_data);
+    
+    uint64_t indexSize = fileSize(m_index) - sizeof(ArchiveHeader);
+    size_t count = indexSize / sizeof(ArchiveEntry);
+    if(count > 0) {
+        void *map = mmap(NULL, sizeof(ArchiveHeader) + indexSize, PROT_READ,
+                         MAP_SHARED, m_index, 0);
+        if(map == MAP_FAILED) {
+            perror(indexName.c_str());
+            return false;
+        }
+        ArchiveEntry *entries =
+            (ArchiveEntry *) ((char *) map + sizeof(ArchiveHeader));
+        m_entries.assign(entries, entries + count);
+        munmap(map, sizeof(ArchiveHeader) + indexSize);
+    }
+    if(!recover()) return false;
+    for(size_t i = 0; i < m_entries.size(); i++)
+        m_hashes.insert(m_entries[i].hash);
+    return true;
+}
+
+/**
+ * Bring the index back in line with the data file after an interrupted
+ * write: drop entries for records which never made it to disk, truncate any
+ * partial record, and index any records which are missing from the index.
+ * 
+ * @return  true on success
+ */
+bool Archive::recover() {
+    while(!m_entries.empty()) {
+        ArchiveEntry &last = m_entries.back();
+        const ArchiveRecord *record = (const ArchiveRecord *)
+            map(last.offset, sizeof(ArchiveRecord));
+        if(record && last.offset + sizeof(ArchiveRecord)
+                     + ALIGN(record->length) <= m_dataSize)
+            break;
+        m_entries.pop_back();
+    }
+    uint64_t offset = sizeof(ArchiveHeader);
+    if(!m_entries.empty()) {
+        const ArchiveRecord *record = (const ArchiveRecord *)
+            map(m_entries.back().offset, sizeof(ArchiveRecord));
+        offset = m_entries.back().offset + sizeof(ArchiveRecord)
+               + ALIGN(record->length);
+    }
+    if(ftruncate(m_index, sizeof(ArchiveHeader)
+                          + m_entries.size() * sizeof(ArchiveEntry)) < 0)
+        return false;
+    
+    while(offset + sizeof(ArchiveRecord) <= m_dataSize) {
+        const ArchiveRecord *record =
+            (const ArchiveRecord *) map(offset, sizeof(ArchiveRecord));
+        uint64_t next = offset + sizeof(ArchiveRecord) + ALIGN(record->length);
+        if(next > m_dataSize) break;
+        ArchiveEntry entry;
+        entry.hash = record->hash;
+        entry.offset = offset;
+        entry.level = record->level;
+        entry.fitness = record->fitness;
+        if(write(m_index, &entry, sizeof(entry)) != sizeof(entry))
+            return false;
+        m_entries.push_back(entry);
+        offset = next;
+    }
+    if(offset < m_dataSize) {
+        if(ftruncate(m_data, offset) < 0) return false;
+        m_dataSize = offset;
+    }
+    return true;
+}
+
+/**
+ * Record a genome, unless an identical one has been recorded before.
+ * 
+ * @param genome   the genome
+ * @param fitness  its fitness
+ * @return         true if the genome was new
+ */
+bool Archive::record(NEAT::Genome *genome, double fitness) {
+    std::string data;
+    encodeGenome(genome, data);
+    uint64_t hash = hashBytes(data.data(), data.size());
+    if(!m_hashes.insert(hash).second) return false;
+    
+    ArchiveRecord record;
+    memset(&record, 0, sizeof(record));
+    record.length = data.size();
+    record.level = m_level;
+    record.fitness = fitness;
+    record.hash = hash;
+    data.insert(0, (const char *) &record, sizeof(record));
+    data.resize(ALIGN(data.size()), '\0');
+    if(write(m_data, data.data(), data.size()) != (ssize_t) data.size()) {
+        perror("archive");
+        return false;
+    }
+    
+    ArchiveEntry entry;
+    entry.hash = hash;
+    entry.offset = m_dataSize;
+    entry.level = m_level;
+    entry.fitness = fitness;
+    m_dataSize += data.size();
+    if(write(m_index, &entry, sizeof(entry)) != sizeof(entry))
+        perror("archive index"); // recovered from the data on next open
+    m_entries.push_back(entry);
+    m_sorted = false;
+    return true;
+}
+
+/**
+ * Return the number of genomes in the archive.
+ * 
+ * @return  the number of genomes
+ */
+int Archive::size() {
+    return m_entries.size();
+}
+
+/**
+ * Decode the fittest genomes recorded for the current level.
+ * 
+ * @param n         the maximum number of genomes
+ * @param genomes   the vector to append the genomes to
+ * @param anyLevel  consider genomes recorded for every level
+ * @return          the number of genomes appended
+ */
+int Archive::best(int n, std::vector<NEAT::Genome*> &genomes, bool anyLevel) {
+    std::vector<ArchiveEntry> top;
+    if(anyLevel) {
+        size_t k = std::min((size_t) n, m_entries.size());
+        top.resize(k);
+        std::partial_sort_copy(m_entries.begin(), m_entries.end(),
+                               top.begin(), top.end(), byFitness);
+    } else {
+        if(!m_sorted) {
+            std::sort(m_entries.begin(), m_entries.end(), byLevelAndFitness);
+            m_sorted = true;
+        }
+        ArchiveEntry key;
+        key.level = m_level;
+        std::vector<ArchiveEntry>::iterator first = std::lower_bound(
+            m_entries.begin(), m_entries.end(), key, byLevel);
+        for(std::vector<ArchiveEntry>::iterator i = first;
+            i != m_entries.end() && i->level == m_level
+            && (int) top.size() < n; i++)
+            top.push_back(*i);
+    }
+    
+    int count = 0;
+    for(size_t i = 0; i < top.size(); i++) {
+        const ArchiveRecord *record = (const ArchiveRecord *)
+            map(top[i].offset, sizeof(ArchiveRecord));
+        const char *data = record ?
+            map(top[i].offset + sizeof(ArchiveRecord), record->length) : NULL;
+        NEAT::Genome *genome =
+            data ? decodeGenome(count + 1, data, record->length) : NULL;
+        if(!genome) continue;
+        genomes.push_back(genome);
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Return the identifier under which genomes are recorded for a level.
+ * 
+ * @param level  the name of the level file
+ * @return       the identifier
+ */
+uint32_t Archive::levelId(const char *level) {
+    const char *base = strrchr(level, '/');
+    base = base ? base + 1 : level;
+    return (uint32_t) hashBytes(base, strlen(base));
+}
+
+/**
+ * Return a pointer to the given range of the data file, remapping it if it
+ * has grown.
+ * 
+ * @param offset  the offset of the range
+ * @param length  the length of the range
+ * @return        the pointer, or NULL if the range lies outside the file
+ */
+const char *Archive::map(uint64_t offset, uint64_t length) {
+    if(offset + length > m_dataSize) return NULL;
+    if(offset + length > m_mapSize) {
+        if(m_map) munmap(m_map, m_mapSize);
+        void *map = mmap(NULL, m_dataSize, PROT_READ, MAP_SHARED, m_data, 0);
+        if(map == MAP_FAILED) {
+            m_map = NULL;
+            m_mapSize = 0;
+            return NULL;
+        }
+        m_map = (char *) map;
+        m_mapSize = m_dataSize;
+    }
+    return m_map + offset;
+}
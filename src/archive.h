@@ -0,0 +1,99 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <string>
+#include <vector>
+#include <tr1/unordered_set>
+
+#include <stdint.h>
+
+#include <NEAT/genome.h>
+
+#define ARCHIVE_MAGIC 0x4e465448 /* "HTFN" */
+#define ARCHIVE_VERSION 1
+
+/** Header of each record in the data file, followed by the genome */
+struct ArchiveRecord {
+    uint32_t length;
+    uint32_t level;
+    float fitness;
+    uint32_t pad;
+    uint64_t hash;
+};
+
+/** An entry in the index file, one per record */
+struct ArchiveEntry {
+    uint64_t hash;
+    uint64_t offset;
+    uint32_t level;
+    float fitness;
+};
+
+/**
+ * An append-only hall of fame of elite genomes, deduplicated by a hash of
+ * their encoding.
+ * 
+ * Genomes are stored compactly in a data file which is only ever appended
+ * to and is read through a memory mapping. A separate index file holds a
+ * fixed-size entry per record, so that opening an archive of millions of
+ * genomes only has to read the index. Lookups by level and fitness go through
+ * an in-memory copy of the index, sorted on demand.
+ */
+class Archive {
+public:
+    Archive();
+    ~Archive();
+    bool open(const char *filename, const char *level);
+    bool record(NEAT::Genome *genome, double fitness);
+    int size();
+    int best(int n, std::vector<NEAT::Genome*> &genomes, bool anyLevel = false);
+    
+    static uint32_t levelId(const char *level);
+    
+protected:
+    /** Descriptor of the data file */
+    int m_data;
+    /** Descriptor of the index file */
+    int m_index;
+    /** Size of the data file */
+    uint64_t m_dataSize;
+    /** Mapping of the data file */
+    char *m_map;
+    /** Size of the mapping */
+    uint64_t m_mapSize;
+    /** The level being recorded */
+    uint32_t m_level;
+    /** Copy of the index */
+    std::vector<ArchiveEntry> m_entries;
+    /** Is m_entries sorted by level and fitness? */
+    bool m_sorted;
+    /** Hashes of all archived genomes */
+    std::tr1::unordered_set<uint64_t> m_hashes;
+    
+    bool recover();
+    const char *map(uint64_t offset, uint64_t length);
+};
+
+#endif
@@ -0,0 +1,216 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+// The nodes, links, genes and traits that rtNEAT allocates for each genome
+// and network are served from size-segregated slabs in one reserved region of
+// address space. rtNEAT's classes can't be given their own allocators, so the
+// global operator new serves a thread from the arena only while it holds an
+// ArenaScope, around the calls that build genomes and networks; every other
+// allocation goes straight to malloc without taking the arena's lock. Freed
+// objects go onto a free list for their size and are reused by the next birth
+// rather than fragmenting the heap, so a long run's footprint levels off at
+// its peak population of genomes; and the objects of a newly built network,
+// being allocated together, tend to share slabs and cache lines.
+
+#include "arena.h"
+
+#include <cstdlib>
+#include <new>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+/** A free object, linked into the list for its size class */
+struct FreeObject {
+    FreeObject *next;
+};
+
+/** A size class: a free list, then the unused tail of its newest slab */
+struct SizeClass {
+    FreeObject *free;
+    char *cursor;
+    char *end;
+};
+
+// Plain data only, so that the arena works before static constructors run
+static pthread_mutex_t arenaLock = PTHREAD_MUTEX_INITIALIZER;
+static char *arenaBase;
+static bool arenaFailed;
+static size_t arenaSlabs;
+static SizeClass arenaClasses[ARENA_NUM_CLASSES];
+/** Size class of each slab; all objects in a slab are the same size */
+static unsigned char arenaSlabClass[ARENA_RESERVE / ARENA_SLAB_SIZE];
+static ArenaStats arenaTotals;
+/** Number of ArenaScopes held by this thread */
+static __thread int arenaDepth;
+
+/**
+ * Reserve the region that slabs are carved from. Pages are only committed
+ * when first touched.
+ */
+static void reserve() {
+    void *p = mmap(NULL, ARENA_RESERVE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(p == MAP_FAILED) arenaFailed = true;
+    else arenaBase = (char *) p;
+}
+
+/**
+ * Allocate memory, from a slab if small enough.
+ * 
+ * @param size  the number of bytes
+ * @return      the memory, or NULL if none is left
+ */
+void *arenaAlloc(size_t size) {
+    if(size == 0) size = 1;
+    if(size > ARENA_MAX_SIZE) return malloc(size);
+    int c = (size - 1) / ARENA_GRANULE;
+    size_t objectSize = (c + 1) * ARENA_GRANULE;
+    pthread_mutex_lock(&arenaLock);
+    if(!arenaBase && !arenaFailed) reserve();
+    SizeClass &sc = arenaClasses[c];
+    void *p = NULL;
+    if(sc.free) {
+        p = sc.free;
+        sc.free = sc.free->next;
+    } else if(sc.cursor + objectSize <= sc.end) {
+        p = sc.cursor;
+        sc.cursor += objectSize;
+    } else if(arenaBase
+              && (arenaSlabs + 1) * ARENA_SLAB_SIZE <= ARENA_RESERVE) {
+        arenaSlabClass[arenaSlabs] = c;
+        sc.cursor = arenaBase + arenaSlabs++ * ARENA_SLAB_SIZE;
+        sc.end = sc.cursor + ARENA_SLAB_SIZE;
+        p = sc.cursor;
+        sc.cursor += objectSize;
+    }
+    if(p) {
+        arenaTotals.allocations++;
+        arenaTotals.bytesInUse += objectSize;
+        if(arenaTotals.bytesInUse > arenaTotals.peakBytes)
+            arenaTotals.peakBytes = arenaTotals.bytesInUse;
+    }
+    pthread_mutex_unlock(&arenaLock);
+    return p ? p : malloc(size); // the region is exhausted
+}
+
+/**
+ * Free memory allocated by arenaAlloc().
+ * 
+ * @param p  the memory, or NULL
+ */
+void arenaFree(void *p) {
+    char *q = (char *) p;
+    if(!arenaBase || q < arenaBase || q >= arenaBase + ARENA_RESERVE) {
+        free(p);
+        return;
+    }
+    int c = arenaSlabClass[(q - arenaBase) / ARENA_SLAB_SIZE];
+    FreeObject *object = (FreeObject *) p;
+    pthread_mutex_lock(&arenaLock);
+    object->next = arenaClasses[c].free;
+    arenaClasses[c].free = object;
+    arenaTotals.frees++;
+    arenaTotals.bytesInUse -= (c + 1) * ARENA_GRANULE;
+    pthread_mutex_unlock(&arenaLock);
+}
+
+/**
+ * Return a snapshot of the arena's usage.
+ * 
+ * @param stats  set to the usage
+ */
+void arenaStats(ArenaStats *stats) {
+    pthread_mutex_lock(&arenaLock);
+    *stats = arenaTotals;
+    stats->slabs = arenaSlabs;
+    pthread_mutex_unlock(&arenaLock);
+}
+
+ArenaScope::ArenaScope() {
+    arenaDepth++;
+}
+
+ArenaScope::~ArenaScope() {
+    arenaDepth--;
+}
+
+#if __cplusplus >= 201103L
+#define THROW_BAD_ALLOC
+#define THROW_NOTHING noexcept
+#else
+#define THROW_BAD_ALLOC throw(std::bad_alloc)
+#define THROW_NOTHING throw()
+#endif
+
+/**
+ * Allocate memory from the arena if this thread holds an ArenaScope.
+ */
+static void *allocate(size_t size) {
+    if(arenaDepth > 0) return arenaAlloc(size);
+    return malloc(size ? size : 1);
+}
+
+void *operator new(size_t size) THROW_BAD_ALLOC {
+    void *p = allocate(size);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) THROW_BAD_ALLOC {
+    void *p = allocate(size);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) THROW_NOTHING {
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) THROW_NOTHING {
+    return allocate(size);
+}
+
+void operator delete(void *p) THROW_NOTHING {
+    arenaFree(p);
+}
+
+void operator delete[](void *p) THROW_NOTHING {
+    arenaFree(p);
+}
+
+void operator delete(void *p, size_t) THROW_NOTHING {
+    arenaFree(p);
+}
+
+void operator delete[](void *p, size_t) THROW_NOTHING {
+    arenaFree(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) THROW_NOTHING {
+    arenaFree(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) THROW_NOTHING {
+    arenaFree(p);
+}
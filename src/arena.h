@@ -0,0 +1,62 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+
+#define ARENA_RESERVE (1UL << 30) /* address space reserved for slabs */
+#define ARENA_SLAB_SIZE 65536
+#define ARENA_GRANULE 16
+#define ARENA_MAX_SIZE 256 /* larger allocations go to malloc */
+#define ARENA_NUM_CLASSES (ARENA_MAX_SIZE / ARENA_GRANULE)
+
+/** Memory usage of the arena */
+struct ArenaStats {
+    /** Slabs carved out of the reserved region so far */
+    size_t slabs;
+    /** Bytes of arena objects currently allocated */
+    size_t bytesInUse;
+    /** Highest value of bytesInUse so far */
+    size_t peakBytes;
+    /** Arena objects allocated and freed so far */
+    unsigned long long allocations;
+    unsigned long long frees;
+};
+
+void *arenaAlloc(size_t size);
+void arenaFree(void *p);
+void arenaStats(ArenaStats *stats);
+
+/**
+ * While held, small allocations made by the current thread, such as the parts
+ * of genomes and networks that rtNEAT builds, are served from the arena.
+ * Scopes nest, and memory allocated in one may be freed anywhere.
+ */
+class ArenaScope {
+public:
+    ArenaScope();
+    ~ArenaScope();
+};
+
+#endif
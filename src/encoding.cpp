@@ -0,0 +1,232 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#include "encoding.h"
+
+#include <cstring>
+#include <map>
+#include <vector>
+
+/*
+ * Genomes are encoded compactly as follows, where "varint" is an unsigned
+ * LEB128 integer and "float" is a little-endian IEEE single:
+ * 
+ *   varint numTraits, then per trait:
+ *     varint id, float params[NEAT::num_trait_params]
+ *   varint numNodes, then per node:
+ *     varint id, byte (type | place << 1), varint trait id (0 for none)
+ *   varint numGenes, then per gene:
+ *     varint index of in node, varint index of out node,
+ *     byte (recurrent | enable << 1 | frozen << 2), varint trait id,
+ *     float weight, varint innovation number, float mutation number
+ * 
+ * Node indices refer to positions in the node list, which keeps the common
+ * case of small genomes to a few bytes per gene.
+ */
+
+#define GENE_RECURRENT 1
+#define GENE_ENABLE 2
+#define GENE_FROZEN 4
+
+/**
+ * Append an unsigned integer in LEB128 format.
+ * 
+ * @param value  the value
+ * @param out    the buffer to append to
+ */
+void encodeVarint(unsigned long long value, std::string &out) {
+    while(value >= 0x80) {
+        out += (char) (value | 0x80);
+        value >>= 7;
+    }
+    out += (char) value;
+}
+
+/**
+ * Read an unsigned integer in LEB128 format.
+ * 
+ * @param p      the read position, which is advanced past the value
+ * @param end    the end of the buffer
+ * @param value  the value read
+ * @return       false if the buffer ended prematurely
+ */
+bool decodeVarint(const char *&p, const char *end, unsigned long long &value) {
+    value = 0;
+    for(int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char c = *p++;
+        value |= (unsigned long long) (c & 0x7f) << shift;
+        if(!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+/**
+ * Return the 64-bit FNV-1a hash of the given bytes. Since the encoding of a
+ * genome is canonical, this hashes both its structure and its weights.
+ * 
+ * @param data    the bytes
+ * @param length  the number of bytes
+ * @return        the hash
+ */
+unsigned long long hashBytes(const char *data, size_t length) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for(size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void encodeFloat(double value, std::string &out) {
+    float f = value;
+    unsigned char bytes[sizeof(float)];
+    memcpy(bytes, &f, sizeof(float));
+    out.append((const char *) bytes, sizeof(float));
+}
+
+static bool decodeFloat(const char *&p, const char *end, double &value) {
+    if(end - p < (long) sizeof(float)) return false;
+    float f;
+    memcpy(&f, p, sizeof(float));
+    p += sizeof(float);
+    value = f;
+    return true;
+}
+
+static int traitId(NEAT::Trait *trait) {
+    return trait ? trait->trait_id : 0;
+}
+
+/**
+ * Encode the given genome.
+ * 
+ * @param genome  the genome
+ * @param out     the buffer to append the encoding to
+ */
+void encodeGenome(NEAT::Genome *genome, std::string &out) {
+    encodeVarint(genome->traits.size(), out);
+    for(std::vector<NEAT::Trait*>::iterator
+        i = genome->traits.begin(), e = genome->traits.end(); i != e; i++) {
+        encodeVarint((*i)->trait_id, out);
+        for(int j = 0; j < NEAT::num_trait_params; j++)
+            encodeFloat((*i)->params[j], out);
+    }
+    
+    std::map<NEAT::NNode*, int> index;
+    int numNodes = 0;
+    encodeVarint(genome->nodes.size(), out);
+    for(std::vector<NEAT::NNode*>::iterator
+        i = genome->nodes.begin(), e = genome->nodes.end(); i != e; i++) {
+        index[*i] = numNodes++;
+        encodeVarint((*i)->node_id, out);
+        out += (char) ((*i)->type | (*i)->gen_node_label << 1);
+        encodeVarint(traitId((*i)->nodetrait), out);
+    }
+    
+    encodeVarint(genome->genes.size(), out);
+    for(std::vector<NEAT::Gene*>::iterator
+        i = genome->genes.begin(), e = genome->genes.end(); i != e; i++) {
+        NEAT::Link *link = (*i)->lnk;
+        encodeVarint(index[link->in_node], out);
+        encodeVarint(index[link->out_node], out);
+        out += (char) ((link->is_recurrent ? GENE_RECURRENT : 0)
+                     | ((*i)->enable ? GENE_ENABLE : 0)
+                     | ((*i)->frozen ? GENE_FROZEN : 0));
+        encodeVarint(traitId(link->linktrait), out);
+        encodeFloat(link->weight, out);
+        encodeVarint((unsigned long long) (*i)->innovation_num, out);
+        encodeFloat((*i)->mutation_num, out);
+    }
+}
+
+/**
+ * Decode a genome.
+ * 
+ * @param id      the id to give the genome
+ * @param data    the encoded genome
+ * @param length  the length of the encoding
+ * @return        the genome, or NULL if the encoding is malformed
+ */
+NEAT::Genome *decodeGenome(int id, const char *data, size_t length) {
+    const char *p = data, *end = data + length;
+    unsigned long long n, value;
+    std::vector<NEAT::Trait*> traits;
+    std::vector<NEAT::NNode*> nodes;
+    std::vector<NEAT::Gene*> genes;
+    std::map<int, NEAT::Trait*> traitById;
+    traitById[0] = NULL;
+    
+    bool ok = decodeVarint(p, end, n);
+    for(unsigned long long i = 0; ok && i < n; i++) {
+        NEAT::Trait *trait = new NEAT::Trait();
+        traits.push_back(trait);
+        ok = decodeVarint(p, end, value);
+        trait->trait_id = value;
+        traitById[trait->trait_id] = trait;
+        for(int j = 0; ok && j < NEAT::num_trait_params; j++)
+            ok = decodeFloat(p, end, trait->params[j]);
+    }
+    
+    ok = ok && decodeVarint(p, end, n);
+    for(unsigned long long i = 0; ok && i < n; i++) {
+        unsigned long long nodeId, trait;
+        ok = decodeVarint(p, end, nodeId) && p < end;
+        if(!ok) break;
+        int flags = (unsigned char) *p++;
+        ok = decodeVarint(p, end, trait) && traitById.count(trait);
+        if(!ok) break;
+        NEAT::NNode *node = new NEAT::NNode(
+            (NEAT::nodetype) (flags & 1), nodeId,
+            (NEAT::nodeplace) (flags >> 1));
+        node->nodetrait = traitById[trait];
+        nodes.push_back(node);
+    }
+    
+    ok = ok && decodeVarint(p, end, n);
+    for(unsigned long long i = 0; ok && i < n; i++) {
+        unsigned long long in, out, trait, innovation;
+        double weight, mutation;
+        ok = decodeVarint(p, end, in) && decodeVarint(p, end, out)
+            && in < nodes.size() && out < nodes.size() && p < end;
+        if(!ok) break;
+        int flags = (unsigned char) *p++;
+        ok = decodeVarint(p, end, trait) && traitById.count(trait)
+            && decodeFloat(p, end, weight)
+            && decodeVarint(p, end, innovation)
+            && decodeFloat(p, end, mutation);
+        if(!ok) break;
+        NEAT::Gene *gene = new NEAT::Gene(traitById[trait], weight,
+            nodes[in], nodes[out], flags & GENE_RECURRENT, innovation,
+            mutation);
+        gene->enable = flags & GENE_ENABLE;
+        gene->frozen = flags & GENE_FROZEN;
+        genes.push_back(gene);
+    }
+    
+    if(!ok || p != end) {
+        for(size_t i = 0; i < genes.size(); i++) delete genes[i];
+        for(size_t i = 0; i < nodes.size(); i++) delete nodes[i];
+        for(size_t i = 0; i < traits.size(); i++) delete traits[i];
+        return NULL;
+    }
+    return new NEAT::Genome(id, traits, nodes, genes);
+}
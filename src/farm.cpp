@@ -0,0 +1,299 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#include "farm.h"
+#include "arena.h"
+#include "encoding.h"
+#include "level.h"
+#include "organism.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static bool readFully(int fd, void *buffer, size_t length) {
+    char *p = (char *) buffer;
+    while(length > 0) {
+        ssize_t n = read(fd, p, length);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        p += n; length -= n;
+    }
+    return true;
+}
+
+static bool writeFully(int fd, const void *buffer, size_t length) {
+    const char *p = (const char *) buffer;
+    while(length > 0) {
+        ssize_t n = write(fd, p, length);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        p += n; length -= n;
+    }
+    return true;
+}
+
+/**
+ * Create a farm for the given level and start its workers.
+ * 
+ * @param levelFile   the name of the file describing the level
+ * @param numWorkers  the number of worker processes
+ */
+Farm::Farm(const char *levelFile, int numWorkers)
+    : Population(NULL, Level::readLifetime(levelFile)), m_levelFile(levelFile),
+      m_workers(std::min(numWorkers, m_size)),
+      m_assignments(m_size, 0) {
+    evolve = true;
+    // reports arrive once per organism per lifetime, rather than once per tick
+    m_reportsPerEvolution = (int) ((double) m_evolutionSpacing
+        * m_size / NEAT::time_alive_minimum + 0.5);
+    if(m_reportsPerEvolution < 1) m_reportsPerEvolution = 1;
+    signal(SIGPIPE, SIG_IGN);
+    for(size_t w = 0; w < m_workers.size(); w++) {
+        m_workers[w].pid = -1;
+        m_workers[w].in = m_workers[w].out = -1;
+    }
+    for(size_t w = 0; w < m_workers.size(); w++)
+        startWorker(w);
+}
+
+Farm::~Farm() {
+    for(size_t w = 0; w < m_workers.size(); w++)
+        stopWorker(w);
+}
+
+/**
+ * Process reports from the workers, evolving the population, forever.
+ */
+void Farm::run() {
+    std::vector<struct pollfd> fds(m_workers.size());
+    while(true) {
+        for(size_t w = 0; w < m_workers.size(); w++) {
+            fds[w].fd = m_workers[w].in;
+            fds[w].events = POLLIN;
+            fds[w].revents = 0;
+        }
+        if(poll(&fds[0], fds.size(), -1) < 0) {
+            if(errno == EINTR) continue;
+            perror("poll");
+            return;
+        }
+        for(size_t w = 0; w < m_workers.size(); w++) {
+            if(!fds[w].revents || receive(w)) continue;
+            fprintf(stderr, "worker %d (pid %d) died, restarting\n",
+                (int) w, (int) m_workers[w].pid);
+            stopWorker(w);
+            startWorker(w);
+        }
+    }
+}
+
+/**
+ * Replace an rtNEAT organism, sending the new one to the relevant worker.
+ * 
+ * @param oldOrganism  the rtNEAT organism to replace
+ * @param newOrganism  the new rtNEAT organism
+ */
+void Farm::replaceOrganism(NEAT::Organism *oldOrganism,
+                           NEAT::Organism *newOrganism) {
+    int slot = slotOf(oldOrganism);
+    if(slot < 0) return;
+    bind(slot, newOrganism);
+    m_assignments[slot]++;
+    assign(slot); // failure is noticed and handled by run()
+}
+
+/**
+ * Fork the w-th worker and send it its share of the organisms.
+ * 
+ * @param w  the index of the worker
+ */
+void Farm::startWorker(int w) {
+    int toWorker[2], fromWorker[2];
+    if(pipe(toWorker) < 0 || pipe(fromWorker) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if(pid == 0) {
+        close(toWorker[1]);
+        close(fromWorker[0]);
+        for(size_t v = 0; v < m_workers.size(); v++) {
+            if(m_workers[v].in >= 0) close(m_workers[v].in);
+            if(m_workers[v].out >= 0) close(m_workers[v].out);
+        }
+        runWorker(w, toWorker[0], fromWorker[1]);
+        _exit(0);
+    }
+    close(toWorker[0]);
+    close(fromWorker[1]);
+    m_workers[w].pid = pid;
+    m_workers[w].out = toWorker[1];
+    m_workers[w].in = fromWorker[0];
+    for(int i = w; i < m_size; i += m_workers.size())
+        if(!assign(i)) break;
+}
+
+/**
+ * Kill the w-th worker, if it is still running.
+ * 
+ * @param w  the index of the worker
+ */
+void Farm::stopWorker(int w) {
+    Worker &worker = m_workers[w];
+    if(worker.pid < 0) return;
+    close(worker.out);
+    close(worker.in);
+    kill(worker.pid, SIGKILL);
+    waitpid(worker.pid, NULL, 0);
+    worker.pid = -1;
+    worker.in = worker.out = -1;
+}
+
+/**
+ * Send the genome, fitness and age of the given slot to its worker.
+ * 
+ * @param slot  the index of the organism
+ * @return      false if the worker could not be reached
+ */
+bool Farm::assign(int slot) {
+    NEAT::Organism *organism = m_organisms[slot].getNEATOrganism();
+    std::string genome;
+    encodeGenome(organism->gnome, genome);
+    FarmMessage message;
+    memset(&message, 0, sizeof(message));
+    message.type = FARM_ASSIGN;
+    message.slot = slot;
+    message.assignment = m_assignments[slot];
+    message.timeAlive = organism->time_alive;
+    message.fitness = organism->fitness;
+    message.length = genome.size();
+    Worker &worker = m_workers[slot % m_workers.size()];
+    return writeFully(worker.out, &message, sizeof(message))
+        && writeFully(worker.out, genome.data(), genome.size());
+}
+
+/**
+ * Receive a report from the w-th worker, evolving the population if due.
+ * 
+ * @param w  the index of the worker
+ * @return   false if the worker has died
+ */
+bool Farm::receive(int w) {
+    FarmMessage message;
+    if(!readFully(m_workers[w].in, &message, sizeof(message))
+       || message.type != FARM_REPORT
+       || message.slot < 0 || message.slot >= m_size)
+        return false;
+    if(message.assignment != m_assignments[message.slot])
+        return true; // report on an organism which has since been replaced
+    NEAT::Organism *organism = m_organisms[message.slot].getNEATOrganism();
+    organism->fitness = message.fitness;
+    organism->time_alive = message.timeAlive;
+    reindex(message.slot);
+    // m_ticksSinceEvolution counts reports rather than ticks here
+    if(evolve && ++m_ticksSinceEvolution >= m_reportsPerEvolution)
+        evolvePopulation();
+    return true;
+}
+
+/**
+ * Main loop of the w-th worker: host the organisms in slots w, w + n, w + 2n,
+ * ... (for n workers) in a headless level, reporting their fitness at the end
+ * of each lifetime. Exits when the coordinator goes away.
+ * 
+ * @param w    the index of the worker
+ * @param in   the pipe to receive assignments on
+ * @param out  the pipe to send reports on
+ */
+void Farm::runWorker(int w, int in, int out) {
+    int n = m_workers.size();
+    int numSlots = (m_size - w + n - 1) / n;
+    srand(time(NULL) ^ getpid());
+    Level level(m_levelFile.c_str(), numSlots);
+    Population *population = level.getPopulation();
+    population->evolve = false;
+    
+    std::vector<int> assignments(numSlots, -1);
+    std::vector<NEAT::Organism*> owned(numSlots, (NEAT::Organism *) NULL);
+    std::vector<FarmMessage> reports;
+    std::vector<char> genome;
+    int pending = numSlots; // slots yet to receive their first genome
+    while(true) {
+        struct pollfd fd = { in, POLLIN, 0 };
+        while(poll(&fd, 1, pending > 0 ? -1 : 0) > 0) {
+            FarmMessage message;
+            if(!readFully(in, &message, sizeof(message))
+               || message.type != FARM_ASSIGN)
+                _exit(0); // coordinator has gone away
+            genome.resize(message.length + 1);
+            if(!readFully(in, &genome[0], message.length)) _exit(0);
+            int j = message.slot / n;
+            ArenaScope scope;
+            NEAT::Genome *g =
+                decodeGenome(message.slot, &genome[0], message.length);
+            if(!g || j >= numSlots) _exit(1);
+            NEAT::Organism *organism = new NEAT::Organism(0.0, g, 0);
+            organism->fitness = message.fitness;
+            organism->time_alive = message.timeAlive;
+            population->setNEATOrganism(j, organism);
+            delete owned[j]; // the originals belong to the NEAT population
+            owned[j] = organism;
+            if(assignments[j] < 0) pending--;
+            assignments[j] = message.assignment;
+            fd.revents = 0;
+        }
+        
+        level.step();
+        reports.clear();
+        for(int j = 0; j < numSlots; j++) {
+            Organism *organism = population->getOrganism(j);
+            if(!organism->takeEvaluated()) continue; // report each run once
+            FarmMessage report;
+            memset(&report, 0, sizeof(report));
+            report.type = FARM_REPORT;
+            report.slot = w + j * n;
+            report.assignment = assignments[j];
+            report.timeAlive = organism->getTimeAlive();
+            report.fitness = organism->getFitness();
+            reports.push_back(report);
+        }
+        if(!reports.empty()
+           && !writeFully(out, &reports[0],
+                          reports.size() * sizeof(FarmMessage)))
+            _exit(0);
+    }
+}
@@ -0,0 +1,98 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#ifndef FARM_H
+#define FARM_H
+
+#include "population.h"
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/** Messages exchanged between the coordinator and its workers */
+enum FarmMessageType {
+    FARM_ASSIGN, /* coordinator -> worker: evaluate the following genome */
+    FARM_REPORT  /* worker -> coordinator: an organism finished a lifetime */
+};
+
+/** Header of a message, followed by length bytes of encoded genome */
+struct FarmMessage {
+    int32_t type;
+    /** Index of the organism in the coordinator's population */
+    int32_t slot;
+    /** Incremented whenever a slot is given a new genome */
+    int32_t assignment;
+    int32_t timeAlive;
+    double fitness;
+    uint32_t length;
+    uint32_t pad;
+};
+
+/**
+ * A population whose organisms are evaluated by a pool of forked worker
+ * processes, each running its own headless copy of the level.
+ * 
+ * The coordinator owns the rtNEAT population. Each worker hosts a fixed share
+ * of the organisms and reports their fitness at the end of every lifetime;
+ * after each (1 / ineligibleProportion) lifetimes' worth of reports the
+ * coordinator removes the worst organism and sends the offspring to whichever
+ * worker hosted it, preserving rtNEAT's steady-state semantics. A worker that
+ * dies is restarted and given back the organisms it was hosting.
+ */
+class Farm : public Population {
+public:
+    Farm(const char *levelFile, int numWorkers);
+    ~Farm();
+    void run();
+    
+protected:
+    /** A worker process */
+    struct Worker {
+        pid_t pid;
+        /** Pipe to send assignments on */
+        int out;
+        /** Pipe to receive reports on */
+        int in;
+    };
+    
+    /** The level evaluated by the workers */
+    std::string m_levelFile;
+    /** The worker processes */
+    std::vector<Worker> m_workers;
+    /** Current assignment of each slot, to discard stale reports */
+    std::vector<int> m_assignments;
+    /** Number of reports per evolution */
+    int m_reportsPerEvolution;
+    
+    void replaceOrganism(NEAT::Organism *oldOrganism,
+                         NEAT::Organism *newOrganism);
+    void startWorker(int w);
+    void stopWorker(int w);
+    bool assign(int slot);
+    bool receive(int w);
+    void runWorker(int w, int in, int out);
+};
+
+#endif
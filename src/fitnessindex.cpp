@@ -0,0 +1,203 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#include "fitnessindex.h"
+
+#include <NEAT/neat.h>
+
+FitnessIndex::FitnessIndex() {}
+
+/**
+ * Set the number of slots, all of which start out unindexed.
+ * 
+ * @param numSlots  the number of slots
+ */
+void FitnessIndex::resize(int numSlots) {
+    Entry vacant = { false, false, 0.0, NULL, -1 };
+    m_entries.assign(numSlots, vacant);
+    m_groups.clear();
+}
+
+/**
+ * Index the given slot's rtNEAT organism, in place of whatever was indexed
+ * there before.
+ * 
+ * @param slot      the slot
+ * @param organism  the rtNEAT organism now in the slot
+ */
+void FitnessIndex::update(int slot, NEAT::Organism *organism) {
+    remove(slot);
+    Entry &entry = m_entries[slot];
+    entry.present = true;
+    entry.eligible = organism->time_alive >= NEAT::time_alive_minimum;
+    entry.fitness = organism->fitness;
+    entry.species = organism->species;
+    Group &group = m_groups[entry.species];
+    group.members++;
+    if(entry.eligible) {
+        group.total += entry.fitness;
+        group.heap.push_back(slot);
+        entry.position = group.heap.size() - 1;
+        siftUp(group, entry.position);
+    }
+}
+
+/**
+ * Stop indexing the given slot.
+ * 
+ * @param slot  the slot
+ */
+void FitnessIndex::remove(int slot) {
+    Entry &entry = m_entries[slot];
+    if(!entry.present) return;
+    entry.present = false;
+    std::tr1::unordered_map<NEAT::Species*, Group>::iterator
+        i = m_groups.find(entry.species);
+    Group &group = i->second;
+    if(entry.eligible) {
+        group.total -= entry.fitness;
+        int last = group.heap.back();
+        group.heap.pop_back();
+        if(group.heap.empty()) group.total = 0; // drop any rounding error
+        if(last != slot) {
+            place(group, entry.position, last);
+            siftUp(group, entry.position);
+            siftDown(group, m_entries[last].position);
+        }
+    }
+    if(--group.members == 0) m_groups.erase(i);
+}
+
+/**
+ * Return whether the given slot is indexed.
+ * 
+ * @param slot  the slot
+ * @return      true if indexed
+ */
+bool FitnessIndex::contains(int slot) {
+    return m_entries[slot].present;
+}
+
+/**
+ * Return the eligible slot with the lowest fitness adjusted for the size of
+ * its species, as remove_worst() would choose it.
+ * 
+ * @return  the slot, or -1 if no slot is eligible
+ */
+int FitnessIndex::worst() {
+    int worst = -1;
+    double worstFitness = 0;
+    for(std::tr1::unordered_map<NEAT::Species*, Group>::iterator
+        i = m_groups.begin(), e = m_groups.end(); i != e; i++) {
+        if(i->second.heap.empty()) continue;
+        int slot = i->second.heap[0];
+        double fitness = adjustedFitness(slot);
+        if(worst < 0 || fitness < worstFitness
+           || (fitness == worstFitness && slot < worst)) {
+            worst = slot;
+            worstFitness = fitness;
+        }
+    }
+    return worst;
+}
+
+/**
+ * Return the indexed fitness of the given slot divided by the current size
+ * of its species.
+ * 
+ * @param slot  the slot, which must be indexed
+ * @return      the adjusted fitness
+ */
+double FitnessIndex::adjustedFitness(int slot) {
+    const Entry &entry = m_entries[slot];
+    return entry.fitness / entry.species->organisms.size();
+}
+
+/**
+ * Return the mean fitness of the eligible organisms of the given species, as
+ * estimate_average() would compute it.
+ * 
+ * @param species  the species
+ * @return         the mean, or 0 if none are eligible
+ */
+double FitnessIndex::averageEstimate(NEAT::Species *species) {
+    std::tr1::unordered_map<NEAT::Species*, Group>::iterator
+        i = m_groups.find(species);
+    if(i == m_groups.end() || i->second.heap.empty()) return 0;
+    return i->second.total / i->second.heap.size();
+}
+
+/**
+ * Recompute each species' sum of fitness from scratch, discarding the
+ * rounding error accumulated by adding and subtracting.
+ */
+void FitnessIndex::resum() {
+    for(std::tr1::unordered_map<NEAT::Species*, Group>::iterator
+        i = m_groups.begin(), e = m_groups.end(); i != e; i++) {
+        Group &group = i->second;
+        group.total = 0;
+        for(size_t j = 0; j < group.heap.size(); j++)
+            group.total += m_entries[group.heap[j]].fitness;
+    }
+}
+
+/**
+ * Order slots by fitness, breaking ties by slot.
+ */
+bool FitnessIndex::less(int a, int b) {
+    double fa = m_entries[a].fitness, fb = m_entries[b].fitness;
+    return fa < fb || (fa == fb && a < b);
+}
+
+/**
+ * Put a slot at the given position of a heap.
+ */
+void FitnessIndex::place(Group &group, int position, int slot) {
+    group.heap[position] = slot;
+    m_entries[slot].position = position;
+}
+
+void FitnessIndex::siftUp(Group &group, int position) {
+    int slot = group.heap[position];
+    while(position > 0) {
+        int parent = (position - 1) / 2;
+        if(!less(slot, group.heap[parent])) break;
+        place(group, position, group.heap[parent]);
+        position = parent;
+    }
+    place(group, position, slot);
+}
+
+void FitnessIndex::siftDown(Group &group, int position) {
+    int n = group.heap.size();
+    int slot = group.heap[position];
+    while(true) {
+        int child = 2 * position + 1;
+        if(child >= n) break;
+        if(child + 1 < n && less(group.heap[child + 1], group.heap[child]))
+            child++;
+        if(!less(group.heap[child], slot)) break;
+        place(group, position, group.heap[child]);
+        position = child;
+    }
+    place(group, position, slot);
+}
@@ -0,0 +1,90 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#ifndef FITNESSINDEX_H
+#define FITNESSINDEX_H
+
+#include <tr1/unordered_map>
+#include <vector>
+
+#include <NEAT/organism.h>
+#include <NEAT/species.h>
+
+/**
+ * An index of the committed fitness of the organisms in each slot, grouped by
+ * species, so that evolution need not scan the whole population.
+ * 
+ * Each species keeps a min-heap of its eligible organisms (those at least
+ * NEAT::time_alive_minimum ticks old) and the sum of their fitness. The
+ * organism remove_worst() would choose, the one with the lowest fitness
+ * divided by its species' size, is then the top of one of the heaps, and a
+ * species' estimate_average() is its sum over its heap size. Ties are broken
+ * by slot, so the choice does not depend on where species were allocated.
+ * 
+ * The index only changes when told to: whenever the fitness, age or species
+ * of a slot's rtNEAT organism changes, or the slot is refilled or vacated.
+ */
+class FitnessIndex {
+public:
+    FitnessIndex();
+    void resize(int numSlots);
+    void update(int slot, NEAT::Organism *organism);
+    void remove(int slot);
+    bool contains(int slot);
+    int worst();
+    double adjustedFitness(int slot);
+    double averageEstimate(NEAT::Species *species);
+    void resum();
+    
+protected:
+    /** What the index knows of each slot */
+    struct Entry {
+        /** Is the slot indexed? */
+        bool present;
+        bool eligible;
+        double fitness;
+        NEAT::Species *species;
+        /** Position in the species' heap, if eligible */
+        int position;
+    };
+    /** The slots of one species */
+    struct Group {
+        /** Min-heap of eligible slots, by fitness then slot */
+        std::vector<int> heap;
+        /** Sum of the fitness of the eligible slots */
+        double total;
+        /** Number of indexed slots, eligible or not */
+        int members;
+        
+        Group() : total(0), members(0) {}
+    };
+    
+    std::vector<Entry> m_entries;
+    std::tr1::unordered_map<NEAT::Species*, Group> m_groups;
+    
+    bool less(int a, int b);
+    void place(Group &group, int position, int slot);
+    void siftUp(Group &group, int position);
+    void siftDown(Group &group, int position);
+};
+
+#endif
@@ -0,0 +1,209 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#include "governor.h"
+#include "level.h"
+#include "organism.h"
+#include "population.h"
+
+#include <cmath>
+#include <cstdio>
+
+/**
+ * Create a governor for the given level.
+ * 
+ * @param level   the level
+ * @param budget  the seconds a tick may take
+ */
+Governor::Governor(Level *level, double budget)
+    : m_level(level), m_budget(budget),
+      m_baseRefreshPeriod(level->getRefreshPeriod()),
+      m_baseControlPeriod(level->getControlPeriod()),
+      m_baseIterations(SOLVER_ITERATIONS),
+      m_active(level->getPopulation()->getSize()),
+      m_iterations(SOLVER_ITERATIONS),
+      m_controlPeriod(level->getControlPeriod()),
+      m_refreshPeriod(level->getRefreshPeriod()), m_ticks(0),
+      m_organismSeconds(0), m_tickSeconds(0), m_tickCost(0),
+      m_organismCost(0) {}
+
+/**
+ * Record the time spent stepping the organisms in the current tick. Called by
+ * the population.
+ * 
+ * @param seconds  the time
+ */
+void Governor::addOrganismTime(double seconds) {
+    m_organismSeconds += seconds;
+}
+
+/**
+ * Record the cost of a whole tick, adjusting the level's fidelity at the end
+ * of each window. Called by the level after every step.
+ * 
+ * @param seconds  the time spent on the tick
+ */
+void Governor::endTick(double seconds) {
+    m_tickSeconds += seconds;
+    if(++m_ticks < GOVERNOR_WINDOW) return;
+    m_tickCost = m_tickSeconds / m_ticks;
+    m_organismCost = m_organismSeconds / m_ticks / m_active;
+    m_ticks = 0;
+    m_organismSeconds = m_tickSeconds = 0;
+    if(m_tickCost > m_budget)
+        degrade(m_tickCost - m_budget);
+    else if(m_tickCost < GOVERNOR_HEADROOM * m_budget)
+        restore(GOVERNOR_HEADROOM * m_budget - m_tickCost);
+}
+
+/**
+ * Take the next step down in fidelity.
+ * 
+ * @param excess  seconds per tick over the budget
+ */
+void Governor::degrade(double excess) {
+    int size = m_level->getPopulation()->getSize();
+    int minActive = (int) ceil(GOVERNOR_MIN_ACTIVE * size);
+    // refreshes are only forced under approximate incremental sensing
+    bool refreshing = Organism::sensing.incremental
+        && Organism::sensing.errorBound > 0 && m_refreshPeriod > 0;
+    if(refreshing && m_refreshPeriod < GOVERNOR_MAX_REFRESH_PERIOD) {
+        m_refreshPeriod *= 2;
+        if(m_refreshPeriod > GOVERNOR_MAX_REFRESH_PERIOD)
+            m_refreshPeriod = GOVERNOR_MAX_REFRESH_PERIOD;
+    } else if(m_controlPeriod < GOVERNOR_MAX_CONTROL_PERIOD) {
+        m_controlPeriod++;
+    } else if(m_iterations > GOVERNOR_MIN_ITERATIONS) {
+        m_iterations--;
+    } else if(m_active > minActive) {
+        int shed = m_organismCost > 0 ? (int) ceil(excess / m_organismCost)
+                                      : 1;
+        m_active -= shed > 0 ? shed : 1;
+        if(m_active < minActive) m_active = minActive;
+    } else {
+        return; // nothing left to give
+    }
+    apply();
+}
+
+/**
+ * Undo the last step down in fidelity.
+ * 
+ * @param slack  seconds per tick to spare before the restoring threshold
+ */
+void Governor::restore(double slack) {
+    int size = m_level->getPopulation()->getSize();
+    if(m_active < size) {
+        int add = m_organismCost > 0 ? (int) (slack / m_organismCost) : 1;
+        m_active += add > 0 ? add : 1;
+        if(m_active > size) m_active = size;
+    } else if(m_iterations < m_baseIterations) {
+        m_iterations++;
+    } else if(m_controlPeriod > m_baseControlPeriod) {
+        m_controlPeriod--;
+    } else if(m_refreshPeriod > m_baseRefreshPeriod) {
+        m_refreshPeriod /= 2;
+        if(m_refreshPeriod < m_baseRefreshPeriod)
+            m_refreshPeriod = m_baseRefreshPeriod;
+    } else {
+        return; // already at full fidelity
+    }
+    apply();
+}
+
+/**
+ * Apply the current settings to the level, and report them.
+ */
+void Governor::apply() {
+    m_level->getPopulation()->setActive(m_active);
+    m_level->setPhysics(1.0 / FRAME_RATE, m_iterations);
+    m_level->setControlPeriod(m_controlPeriod);
+    m_level->setRefreshPeriod(m_refreshPeriod);
+    printf("governor: %.2f ms per tick of %.2f ms, %.1f us per organism; "
+        "%d active, %d iterations, control period %d, refresh period %d\n",
+        1e3 * m_tickCost, 1e3 * m_budget, 1e6 * m_organismCost, m_active,
+        m_iterations, m_controlPeriod, m_refreshPeriod);
+}
+
+/**
+ * Return the seconds a tick may take.
+ * 
+ * @return  the budget
+ */
+double Governor::getBudget() {
+    return m_budget;
+}
+
+/**
+ * Return the mean cost of a tick over the last window.
+ * 
+ * @return  the cost in seconds
+ */
+double Governor::getTickCost() {
+    return m_tickCost;
+}
+
+/**
+ * Return the mean cost of stepping one active organism for a tick over the
+ * last window, which grows with the complexity of the networks.
+ * 
+ * @return  the cost in seconds
+ */
+double Governor::getOrganismCost() {
+    return m_organismCost;
+}
+
+/**
+ * Return the number of organisms left active.
+ * 
+ * @return  the number of organisms
+ */
+int Governor::getActive() {
+    return m_active;
+}
+
+/**
+ * Return the number of constraint solver iterations per step.
+ * 
+ * @return  the number of iterations
+ */
+int Governor::getIterations() {
+    return m_iterations;
+}
+
+/**
+ * Return the number of ticks between network activations.
+ * 
+ * @return  the control period
+ */
+int Governor::getControlPeriod() {
+    return m_controlPeriod;
+}
+
+/**
+ * Return the number of ticks between forced full queries of each ray.
+ * 
+ * @return  the refresh period
+ */
+int Governor::getRefreshPeriod() {
+    return m_refreshPeriod;
+}
@@ -0,0 +1,88 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#define GOVERNOR_BUDGET 0.8 /* proportion of a frame period a tick may take */
+#define GOVERNOR_HEADROOM 0.7 /* proportion of the budget to restore below */
+#define GOVERNOR_WINDOW 60 /* ticks averaged over between adjustments */
+#define GOVERNOR_MAX_CONTROL_PERIOD 6
+#define GOVERNOR_MAX_REFRESH_PERIOD 240 /* ticks, reached by doubling */
+#define GOVERNOR_MIN_ITERATIONS 2
+#define GOVERNOR_MIN_ACTIVE 0.25 /* proportion of organisms kept active */
+
+class Level;
+
+/**
+ * Keeps a level running in real time by trading fidelity for speed. The cost
+ * of every tick, and of the organisms' part of it, is measured; whenever the
+ * mean over a window of ticks exceeds the budget, the governor takes the next
+ * step down: first, under approximate incremental sensing, forcing full ray
+ * queries less often (the level's refresh period, doubled each step), then
+ * activating networks less often (the level's control period), then running
+ * fewer constraint solver iterations, and finally
+ * suspending organisms, as many as the measured cost per organism says will
+ * fit. When the cost falls well below the budget the same steps are undone in
+ * reverse. Settings never go below those the run started with.
+ */
+class Governor {
+public:
+    Governor(Level *level, double budget);
+    void addOrganismTime(double seconds);
+    void endTick(double seconds);
+    double getBudget();
+    double getTickCost();
+    double getOrganismCost();
+    int getActive();
+    int getIterations();
+    int getControlPeriod();
+    int getRefreshPeriod();
+    
+protected:
+    /** The level being governed */
+    Level *m_level;
+    /** Seconds a tick may take */
+    double m_budget;
+    /** Settings the run started with, which are never exceeded */
+    int m_baseRefreshPeriod;
+    int m_baseControlPeriod;
+    int m_baseIterations;
+    /** Current settings */
+    int m_active;
+    int m_iterations;
+    int m_controlPeriod;
+    int m_refreshPeriod;
+    /** Ticks and seconds measured in the current window */
+    int m_ticks;
+    double m_organismSeconds;
+    double m_tickSeconds;
+    /** Mean cost of a tick, and of an active organism per tick, last window */
+    double m_tickCost;
+    double m_organismCost;
+    
+    void degrade(double excess);
+    void restore(double slack);
+    void apply();
+};
+
+#endif
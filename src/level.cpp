@@ -21,24 +21,54 @@
 */
 
 #include "level.h"
-#include "debugdraw.h"
+#include "governor.h"
 #include "organism.h"
 #include "population.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "trace.h"
 
 #include <fstream>
 #include <cstdio>
+#include <cstdlib>
 
 #define DO_SLEEP 1
 
 const b2Vec2 GRAVITY(0.0, -10.0);
 
+/**
+ * Create counters with nothing counted.
+ */
+EvaluationCounters::EvaluationCounters()
+    : terminations(0), savedTicks(0), totalTicks(0), fullQueries(0),
+      cachedQueries(0) {}
+
+/**
+ * Add another level's counters to these.
+ * 
+ * @param other  the counters to add
+ */
+void EvaluationCounters::add(const EvaluationCounters &other) {
+    terminations += other.terminations;
+    savedTicks += other.savedTicks;
+    totalTicks += other.totalTicks;
+    fullQueries += other.fullQueries;
+    cachedQueries += other.cachedQueries;
+}
+
 /**
  * Load a level from the given file.
  * 
  * @param filename  the name of the file describing the level
+ * @param size      the number of organisms, or 0 for NEAT::pop_size
  */
-Level::Level(const char *filename)
-    : m_time(0) {
+Level::Level(const char *filename, int size)
+    : isolated(false), m_time(0), m_stats(NULL), m_trace(NULL),
+      m_snapshots(NULL), m_governor(NULL), m_seed(rand()),
+      m_timeStep(1.0 / FRAME_RATE),
+      m_iterations(SOLVER_ITERATIONS),
+      m_controlPeriod(Organism::controlPeriod),
+      m_refreshPeriod(Organism::sensing.refreshPeriod) {
     std::ifstream fin(filename);
     while(true) {
         std::string key; fin >> key;
@@ -65,7 +95,8 @@ Level::Level(const char *filename)
             spawnPoint.Set(x, y);
         } else if(key == "lifetime") {
             double t; fin >> t;
-            m_population = new Population(this, (int) (t * FRAME_RATE));
+            m_population = new Population(this, (int) (t * FRAME_RATE),
+                                          size);
             m_population->evolve = true;
             m_population->spawn();
         }
@@ -73,25 +104,51 @@ Level::Level(const char *filename)
     fin.close();
     
     m_world->SetContactListener(this);
-    m_world->SetDebugDraw(&m_debugDraw);
-    m_debugDraw.SetFlags(b2DebugDraw::e_shapeBit);
 }
 
 Level::~Level() {
     delete m_world;
 }
 
+/**
+ * Read the lifetime of the organisms from the given level file, without
+ * loading the level.
+ * 
+ * @param filename  the name of the file describing the level
+ * @return          the lifetime in ticks
+ */
+int Level::readLifetime(const char *filename) {
+    std::ifstream fin(filename);
+    std::string key;
+    while(fin >> key && key != "end") {
+        if(key == "lifetime") {
+            double t; fin >> t;
+            return (int) (t * FRAME_RATE);
+        }
+    }
+    fprintf(stderr, "%s: no lifetime given\n", filename);
+    exit(1);
+}
+
 /**
  * Step the level forward by one timestep.
  */
 void Level::step() {
-    if(m_time % FRAME_RATE == 0 && m_goalChanges.count(m_time / FRAME_RATE))
+    if(m_time % FRAME_RATE == 0 && m_goalChanges.count(m_time / FRAME_RATE)) {
         m_goal = m_goalChanges[m_time / FRAME_RATE];
+        if(m_trace) m_trace->goal(m_goal);
+    }
     m_time++;
+    double start = m_governor ? statsClock() : 0;
     m_population->step();
-    m_world->Step(1.0 / FRAME_RATE, 10);
-    m_debugDraw.DrawSolidCircle(
-        m_goal, 5.0, b2Vec2_zero, b2Color(0.0, 0.5, 1.0));
+    StatsTimer timer(m_stats);
+    m_world->Step(m_timeStep, m_iterations);
+    if(m_snapshots) m_snapshots->publish(this, m_time);
+    if(m_trace) m_trace->tick();
+    timer.lap(STATS_PHASE_PHYSICS);
+    if(m_stats && m_stats->tick())
+        m_stats->publish(m_population);
+    if(m_governor) m_governor->endTick(statsClock() - start);
 }
 
 /**
@@ -109,19 +166,103 @@ b2Vec2 Level::displacementFromGoal(b2Vec2 position) {
  * the ground.
  * 
  * @param segment  the segment
+ * @param hit      if not NULL, set to the shape intersected first, or NULL if
+ *                 there is no intersection
  * @return         the distance to the intersection, where 1.0 is the end point
  *                 of the segment
  */
-double Level::raycast(const b2Segment &segment) {
+double Level::raycast(const b2Segment &segment, b2Shape **hit) {
     float lambda, bestLambda = 1.0;
     b2Vec2 normal;
+    if(hit) *hit = NULL;
     for (b2Shape* s = m_ground->GetShapeList(); s; s = s->GetNext())
         if(s->TestSegment(m_ground->GetXForm(), &lambda, &normal, segment, 1.0)
-           && lambda < bestLambda)
+           && lambda < bestLambda) {
             bestLambda = lambda;
+            if(hit) *hit = s;
+        }
     return bestLambda;
 }
 
+/**
+ * Return the location of the intersection between the given segment and a
+ * single shape of the ground.
+ * 
+ * @param segment  the segment
+ * @param shape    the shape
+ * @return         the distance to the intersection, where 1.0 is the end point
+ *                 of the segment
+ */
+double Level::raycastShape(const b2Segment &segment, b2Shape *shape) {
+    float lambda;
+    b2Vec2 normal;
+    if(shape->TestSegment(m_ground->GetXForm(), &lambda, &normal, segment, 1.0)
+       && lambda < 1.0)
+        return lambda;
+    return 1.0;
+}
+
+GroundClearance::GroundClearance()
+    : nearestShape(NULL), nearest(-1), secondNearest(-1) {}
+
+/**
+ * Return the distance to the ground ignoring one of its shapes.
+ * 
+ * @param shape  the shape of the ground to ignore, or NULL
+ * @return       the distance
+ */
+double GroundClearance::excluding(b2Shape *shape) const {
+    return shape && shape == nearestShape ? secondNearest : nearest;
+}
+
+/**
+ * Measure lower bounds on the distance from the given position to the
+ * ground, and to the ground without its nearest shape, in one pass over the
+ * shapes.
+ * 
+ * @param position   the position
+ * @param clearance  set to the distances, which are zero inside the ground
+ */
+void Level::groundClearance(b2Vec2 position, GroundClearance &clearance) {
+    clearance.nearestShape = NULL;
+    clearance.nearest = clearance.secondNearest = 1e9;
+    const b2XForm &xf = m_ground->GetXForm();
+    b2Vec2 p = b2MulT(xf, position);
+    for (b2Shape* s = m_ground->GetShapeList(); s; s = s->GetNext()) {
+        double distance;
+        if(s->GetType() == e_circleShape) {
+            b2CircleShape *circle = (b2CircleShape *) s;
+            distance = (p - circle->GetLocalPosition()).Length()
+                     - circle->GetRadius();
+        } else {
+            b2PolygonShape *polygon = (b2PolygonShape *) s;
+            const b2Vec2 *v = polygon->GetVertices();
+            int n = polygon->GetVertexCount();
+            bool inside = true;
+            distance = 1e9;
+            for(int i = 0; i < n; i++) {
+                b2Vec2 a = v[i], b = v[(i+1) % n];
+                b2Vec2 edge = b - a;
+                if(b2Cross(edge, p - a) < 0) inside = false;
+                double t = b2Dot(p - a, edge) / edge.LengthSquared();
+                if(t < 0) t = 0;
+                if(t > 1) t = 1;
+                double d = (p - (a + t * edge)).Length();
+                if(d < distance) distance = d;
+            }
+            if(inside) distance = 0;
+        }
+        if(distance < 0) distance = 0;
+        if(distance < clearance.nearest) {
+            clearance.secondNearest = clearance.nearest;
+            clearance.nearest = distance;
+            clearance.nearestShape = s;
+        } else if(distance < clearance.secondNearest) {
+            clearance.secondNearest = distance;
+        }
+    }
+}
+
 /**
  * Reposition the given body.
  * 
@@ -152,6 +293,171 @@ void Level::destroyBody(b2Body *body) {
     m_world->DestroyBody(body);
 }
 
+/**
+ * Publish live statistics for this level.
+ * 
+ * @param stats  the statistics writer, or NULL to disable
+ */
+void Level::setStats(Stats *stats) {
+    m_stats = stats;
+    m_population->stats = stats;
+    if(stats) stats->setGovernor(m_governor);
+}
+
+/**
+ * Record the trajectories of this level's organisms.
+ * 
+ * @param trace  the trace, already opened on this level, or NULL to disable
+ */
+void Level::setTrace(Trace *trace) {
+    m_trace = trace;
+    m_population->trace = trace;
+}
+
+/**
+ * Publish a snapshot of this level after every step, for drawing on another
+ * thread.
+ * 
+ * @param snapshots  the snapshot buffer, or NULL to disable
+ */
+void Level::setSnapshots(SnapshotBuffer *snapshots) {
+    m_snapshots = snapshots;
+}
+
+/**
+ * Hold this level to real time by adapting its fidelity.
+ * 
+ * @param governor  the governor, or NULL to disable
+ */
+void Level::setGovernor(Governor *governor) {
+    m_governor = governor;
+    m_population->governor = governor;
+    if(m_stats) m_stats->setGovernor(governor);
+}
+
+/**
+ * Return a pseudo-random number from this level's own generator, so that
+ * levels stepped on different threads neither contend nor interfere.
+ * 
+ * @return  a number between 0 and 1 inclusive
+ */
+double Level::random() {
+    return (double) rand_r(&m_seed) / RAND_MAX;
+}
+
+/**
+ * Reseed this level's random number generator.
+ * 
+ * @param seed  the seed
+ */
+void Level::setSeed(unsigned seed) {
+    m_seed = seed;
+}
+
+/**
+ * Return the population living in this level.
+ * 
+ * @return  the population
+ */
+Population *Level::getPopulation() {
+    return m_population;
+}
+
+/**
+ * Return the outlines of the polygons making up the ground, in world
+ * coordinates.
+ * 
+ * @param polygons  set to the vertices of each polygon
+ */
+void Level::groundPolygons(std::vector<std::vector<b2Vec2> > &polygons) {
+    polygons.clear();
+    const b2XForm &xf = m_ground->GetXForm();
+    for(b2Shape *s = m_ground->GetShapeList(); s; s = s->GetNext()) {
+        if(s->GetType() != e_polygonShape) continue;
+        b2PolygonShape *polygon = (b2PolygonShape *) s;
+        polygons.push_back(std::vector<b2Vec2>());
+        for(int i = 0; i < polygon->GetVertexCount(); i++)
+            polygons.back().push_back(b2Mul(xf, polygon->GetVertices()[i]));
+    }
+}
+
+/**
+ * Return the current position of the goal.
+ * 
+ * @return  the goal
+ */
+b2Vec2 Level::getGoal() {
+    return m_goal;
+}
+
+/**
+ * Return the number of ticks elapsed.
+ * 
+ * @return  the number of ticks
+ */
+int Level::getTime() {
+    return m_time;
+}
+
+/**
+ * Move the goal to the given position for good, cancelling any repositioning
+ * scheduled by the level file.
+ * 
+ * @param goal  the new goal
+ */
+void Level::setGoal(b2Vec2 goal) {
+    m_goal = goal;
+    m_goalChanges.clear();
+    if(m_trace) m_trace->goal(m_goal);
+}
+
+/**
+ * Change the fidelity of the physics simulation.
+ * 
+ * @param timeStep    seconds simulated per step (1.0/FRAME_RATE by default)
+ * @param iterations  constraint solver iterations per step
+ */
+void Level::setPhysics(double timeStep, int iterations) {
+    m_timeStep = timeStep;
+    m_iterations = iterations;
+}
+
+/**
+ * Return the number of ticks between activations of each network.
+ * 
+ * @return  the control period
+ */
+int Level::getControlPeriod() {
+    return m_controlPeriod;
+}
+
+/**
+ * Set the number of ticks between activations of each network.
+ * 
+ * @param controlPeriod  the control period (at least 1)
+ */
+void Level::setControlPeriod(int controlPeriod) {
+    m_controlPeriod = controlPeriod > 0 ? controlPeriod : 1;
+}
+
+/**
+ * Return the number of ticks between forced full queries of each ray.
+ * 
+ * @return  the refresh period, or 0 for none
+ */
+int Level::getRefreshPeriod() {
+    return m_refreshPeriod;
+}
+
+/**
+ * Set the number of ticks between forced full queries of each ray.
+ * 
+ * @param refreshPeriod  the refresh period, or 0 for none
+ */
+void Level::setRefreshPeriod(int refreshPeriod) {
+    m_refreshPeriod = refreshPeriod > 0 ? refreshPeriod : 0;
+}
+
 void Level::Add(const b2ContactPoint *point) {
     contactPoint(point, false);
 }
@@ -23,30 +23,93 @@
 #ifndef LEVEL_H
 #define LEVEL_H
 
-#include "debugdraw.h"
-
 #include <map>
+#include <vector>
 
 #include <Box2D.h>
 
 #define FRAME_RATE 60
 #define FRAME_PERIOD (1000/FRAME_RATE)
+#define SOLVER_ITERATIONS 10
 
+class Governor;
 class Population;
+class SnapshotBuffer;
+class Stats;
+class Trace;
+
+/** Work done by the organisms of one level, written only by its thread */
+struct EvaluationCounters {
+    /** Number of evaluations terminated early */
+    long long terminations;
+    /** Number of organism-ticks saved by terminating early */
+    long long savedTicks;
+    /** Number of organism-ticks simulated under early termination */
+    long long totalTicks;
+    /** Number of rays answered by a full query */
+    long long fullQueries;
+    /** Number of rays answered from the cache */
+    long long cachedQueries;
+    
+    EvaluationCounters();
+    void add(const EvaluationCounters &other);
+};
+
+/**
+ * Lower bounds on the distance from a point to the ground, measured once and
+ * shared by every ray cast from that point.
+ */
+struct GroundClearance {
+    /** The nearest shape of the ground, or NULL */
+    b2Shape *nearestShape;
+    /** Distance to the nearest shape, or negative if not yet measured */
+    double nearest;
+    /** Distance to the nearest shape other than nearestShape */
+    double secondNearest;
+    
+    GroundClearance();
+    double excluding(b2Shape *shape) const;
+};
 
 class Level : b2ContactListener {
 public:
     /** The position where organisms spawn */
     b2Vec2 spawnPoint;
+    /**
+     * Should the organisms stay out of shared statistics, early termination
+     * and novelty search? Set for private worlds such as a sandbox.
+     */
+    bool isolated;
+    /** Work done by this level's organisms */
+    EvaluationCounters counters;
     
-    Level(const char *filename);
+    Level(const char *filename, int size = 0);
     ~Level();
+    static int readLifetime(const char *filename);
     void step();
     b2Vec2 displacementFromGoal(b2Vec2 position);
-    double raycast(const b2Segment &segment);
+    double raycast(const b2Segment &segment, b2Shape **hit = NULL);
+    double raycastShape(const b2Segment &segment, b2Shape *shape);
+    void groundClearance(b2Vec2 position, GroundClearance &clearance);
     void repositionBody(b2Body *body, b2Vec2 position);
     b2Body *createBody(const b2BodyDef *def);
     void destroyBody(b2Body *body);
+    void setStats(Stats *stats);
+    void setTrace(Trace *trace);
+    void setSnapshots(SnapshotBuffer *snapshots);
+    void setGovernor(Governor *governor);
+    double random();
+    void setSeed(unsigned seed);
+    Population *getPopulation();
+    void groundPolygons(std::vector<std::vector<b2Vec2> > &polygons);
+    b2Vec2 getGoal();
+    int getTime();
+    void setGoal(b2Vec2 goal);
+    void setPhysics(double timeStep, int iterations);
+    int getControlPeriod();
+    void setControlPeriod(int controlPeriod);
+    int getRefreshPeriod();
+    void setRefreshPeriod(int refreshPeriod);
     
     // b2ContactListener
     void Add(const b2ContactPoint *point);
@@ -62,12 +125,32 @@ protected:
     b2Vec2 m_goal;
     /** The population for the level */
     Population *m_population;
-    /** Renderer */
-    DebugDraw m_debugDraw;
     /** Number of ticks elapsed */
     int m_time;
     /** When and where to reposition the goal */
     std::map<int, b2Vec2> m_goalChanges;
+    /** Live statistics, or NULL if disabled */
+    Stats *m_stats;
+    /** Trajectory recorder, or NULL if disabled */
+    Trace *m_trace;
+    /** Snapshots for a render thread, or NULL if disabled */
+    SnapshotBuffer *m_snapshots;
+    /** Governor holding the level to real time, or NULL if disabled */
+    Governor *m_governor;
+    /** State of the level's random number generator */
+    unsigned m_seed;
+    /** Seconds simulated per step */
+    double m_timeStep;
+    /** Constraint solver iterations per step */
+    int m_iterations;
+    /**
+     * Ticks between sensing and activating each network, the last force being
+     * held in between. Organisms are staggered by slot so that each tick
+     * activates an even share of them.
+     */
+    int m_controlPeriod;
+    /** Ticks between forced full queries of each ray (see SensorPolicy) */
+    int m_refreshPeriod;
     
     void contactPoint(const b2ContactPoint *point, bool persist);
 };
@@ -0,0 +1,656 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#include "lineage.h"
+#include "encoding.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <NEAT/gene.h>
+#include <NEAT/link.h>
+#include <NEAT/neat.h>
+#include <NEAT/nnode.h>
+#include <NEAT/species.h>
+#include <NEAT/trait.h>
+
+/*
+ * A genome diff lists what must change to turn the parent's genome into the
+ * child's, where "varint" is an unsigned LEB128 integer and "float" is a
+ * little-endian IEEE single:
+ * 
+ *   varint numTraits, then per new or changed trait:
+ *     varint id, float params[numTraitParams]
+ *   varint numTraits, then per removed trait: varint id
+ *   varint numNodes, then per new or changed node:
+ *     varint id, byte (type | place << 1), varint trait id (0 for none)
+ *   varint numNodes, then per removed node: varint id
+ *   varint numGenes, then per new or changed gene:
+ *     varint innovation number, varint in node id, varint out node id,
+ *     byte (recurrent | enable << 1 | frozen << 2), varint trait id,
+ *     float weight, float mutation number
+ *   varint numGenes, then per removed gene: varint innovation number
+ * 
+ * A founder is diffed against the empty genome. A mutated offspring usually
+ * differs from its parent in a handful of weights and perhaps a node or two,
+ * so its diff is tens of bytes where the whole genome would be hundreds.
+ */
+
+#define GENE_RECURRENT 1
+#define GENE_ENABLE 2
+#define GENE_FROZEN 4
+
+static void encodeFloat(float value, std::string &out) {
+    out.append((const char *) &value, sizeof(value));
+}
+
+static bool decodeFloat(const char *&p, const char *end, float &value) {
+    if(end - p < (long) sizeof(float)) return false;
+    memcpy(&value, p, sizeof(float));
+    p += sizeof(float);
+    return true;
+}
+
+static bool operator!=(const LineageGenome::Node &a,
+                       const LineageGenome::Node &b) {
+    return a.flags != b.flags || a.trait != b.trait;
+}
+
+static bool operator!=(const LineageGenome::Gene &a,
+                       const LineageGenome::Gene &b) {
+    return a.in != b.in || a.out != b.out || a.flags != b.flags
+        || a.trait != b.trait || a.weight != b.weight
+        || a.mutation != b.mutation;
+}
+
+/**
+ * Append the entries of a map that are new or changed in another, then the
+ * keys of those that are missing from it.
+ */
+template<class K, class V, class Encode>
+static void diffMaps(const std::map<K, V> &parent, const std::map<K, V> &child,
+                     Encode encode, std::string &out) {
+    std::string changed;
+    int numChanged = 0, numRemoved = 0;
+    for(typename std::map<K, V>::const_iterator
+        i = child.begin(), e = child.end(); i != e; i++) {
+        typename std::map<K, V>::const_iterator j = parent.find(i->first);
+        if(j == parent.end() || j->second != i->second) {
+            encode(i->first, i->second, changed);
+            numChanged++;
+        }
+    }
+    encodeVarint(numChanged, out);
+    out += changed;
+    std::string removed;
+    for(typename std::map<K, V>::const_iterator
+        i = parent.begin(), e = parent.end(); i != e; i++) {
+        if(!child.count(i->first)) {
+            encodeVarint((unsigned long long) i->first, removed);
+            numRemoved++;
+        }
+    }
+    encodeVarint(numRemoved, out);
+    out += removed;
+}
+
+static void encodeTrait(int id, const std::vector<float> &params,
+                        std::string &out) {
+    encodeVarint(id, out);
+    for(size_t i = 0; i < params.size(); i++)
+        encodeFloat(params[i], out);
+}
+
+static void encodeNode(int id, const LineageGenome::Node &node,
+                       std::string &out) {
+    encodeVarint(id, out);
+    out += (char) node.flags;
+    encodeVarint(node.trait, out);
+}
+
+static void encodeGene(unsigned long long innovation,
+                       const LineageGenome::Gene &gene, std::string &out) {
+    encodeVarint(innovation, out);
+    encodeVarint(gene.in, out);
+    encodeVarint(gene.out, out);
+    out += (char) gene.flags;
+    encodeVarint(gene.trait, out);
+    encodeFloat(gene.weight, out);
+    encodeFloat(gene.mutation, out);
+}
+
+/**
+ * Read the keys of removed entries and erase them from the given map.
+ */
+template<class K, class V>
+static bool applyRemovals(const char *&p, const char *end,
+                          std::map<K, V> &entries) {
+    unsigned long long n, key;
+    if(!decodeVarint(p, end, n)) return false;
+    for(unsigned long long i = 0; i < n; i++) {
+        if(!decodeVarint(p, end, key)) return false;
+        entries.erase((K) key);
+    }
+    return true;
+}
+
+/**
+ * Set this genome to the given rtNEAT genome.
+ * 
+ * @param genome  the rtNEAT genome
+ */
+void LineageGenome::assign(NEAT::Genome *genome) {
+    traits.clear();
+    nodes.clear();
+    genes.clear();
+    for(std::vector<NEAT::Trait*>::iterator
+        i = genome->traits.begin(), e = genome->traits.end(); i != e; i++)
+        traits[(*i)->trait_id].assign((*i)->params,
+                                      (*i)->params + NEAT::num_trait_params);
+    for(std::vector<NEAT::NNode*>::iterator
+        i = genome->nodes.begin(), e = genome->nodes.end(); i != e; i++) {
+        Node &node = nodes[(*i)->node_id];
+        node.flags = (*i)->type | (*i)->gen_node_label << 1;
+        node.trait = (*i)->nodetrait ? (*i)->nodetrait->trait_id : 0;
+    }
+    for(std::vector<NEAT::Gene*>::iterator
+        i = genome->genes.begin(), e = genome->genes.end(); i != e; i++) {
+        NEAT::Link *link = (*i)->lnk;
+        Gene &gene = genes[(unsigned long long) (*i)->innovation_num];
+        gene.in = link->in_node->node_id;
+        gene.out = link->out_node->node_id;
+        gene.flags = (link->is_recurrent ? GENE_RECURRENT : 0)
+                   | ((*i)->enable ? GENE_ENABLE : 0)
+                   | ((*i)->frozen ? GENE_FROZEN : 0);
+        gene.trait = link->linktrait ? link->linktrait->trait_id : 0;
+        gene.weight = link->weight;
+        gene.mutation = (*i)->mutation_num;
+    }
+}
+
+/**
+ * Encode how this genome differs from the given parent.
+ * 
+ * @param parent  the parent's genome, or an empty one for a founder
+ * @param out     the buffer to append the diff to
+ */
+void LineageGenome::diff(const LineageGenome &parent, std::string &out) const {
+    diffMaps(parent.traits, traits, encodeTrait, out);
+    diffMaps(parent.nodes, nodes, encodeNode, out);
+    diffMaps(parent.genes, genes, encodeGene, out);
+}
+
+/**
+ * Turn this genome, being the parent, into the child described by a diff.
+ * 
+ * @param data            the diff
+ * @param length          the length of the diff
+ * @param numTraitParams  the number of parameters of each trait
+ * @return                false if the diff is malformed
+ */
+bool LineageGenome::apply(const char *data, size_t length,
+                          int numTraitParams) {
+    const char *p = data, *end = data + length;
+    unsigned long long n, id, trait, in, out;
+    
+    if(!decodeVarint(p, end, n)) return false;
+    for(unsigned long long i = 0; i < n; i++) {
+        if(!decodeVarint(p, end, id)) return false;
+        std::vector<float> &params = traits[id];
+        params.resize(numTraitParams);
+        for(int j = 0; j < numTraitParams; j++)
+            if(!decodeFloat(p, end, params[j])) return false;
+    }
+    if(!applyRemovals(p, end, traits)) return false;
+    
+    if(!decodeVarint(p, end, n)) return false;
+    for(unsigned long long i = 0; i < n; i++) {
+        if(!decodeVarint(p, end, id) || p >= end) return false;
+        Node &node = nodes[id];
+        node.flags = (unsigned char) *p++;
+        if(!decodeVarint(p, end, trait)) return false;
+        node.trait = trait;
+    }
+    if(!applyRemovals(p, end, nodes)) return false;
+    
+    if(!decodeVarint(p, end, n)) return false;
+    for(unsigned long long i = 0; i < n; i++) {
+        if(!decodeVarint(p, end, id) || !decodeVarint(p, end, in)
+           || !decodeVarint(p, end, out) || p >= end)
+            return false;
+        Gene &gene = genes[id];
+        gene.in = in;
+        gene.out = out;
+        gene.flags = (unsigned char) *p++;
+        if(!decodeVarint(p, end, trait) || !decodeFloat(p, end, gene.weight)
+           || !decodeFloat(p, end, gene.mutation))
+            return false;
+        gene.trait = trait;
+    }
+    if(!applyRemovals(p, end, genes)) return false;
+    return p == end;
+}
+
+/**
+ * Print this genome in a readable form.
+ * 
+ * @param file  the file to print to
+ */
+void LineageGenome::print(FILE *file) const {
+    static const char *places[] = { "hidden", "input", "output", "bias" };
+    for(std::map<int, std::vector<float> >::const_iterator
+        i = traits.begin(), e = traits.end(); i != e; i++) {
+        fprintf(file, "trait %d:", i->first);
+        for(size_t j = 0; j < i->second.size(); j++)
+            fprintf(file, " %g", i->second[j]);
+        fprintf(file, "\n");
+    }
+    for(std::map<int, Node>::const_iterator
+        i = nodes.begin(), e = nodes.end(); i != e; i++)
+        fprintf(file, "node %d: %s %s, trait %d\n", i->first,
+            i->second.flags & 1 ? "sensor" : "neuron",
+            places[(i->second.flags >> 1) & 3], i->second.trait);
+    for(std::map<unsigned long long, Gene>::const_iterator
+        i = genes.begin(), e = genes.end(); i != e; i++)
+        fprintf(file, "gene %llu: %d -> %d, weight %g, trait %d%s%s%s\n",
+            i->first, i->second.in, i->second.out, i->second.weight,
+            i->second.trait,
+            i->second.flags & GENE_ENABLE ? "" : ", disabled",
+            i->second.flags & GENE_RECURRENT ? ", recurrent" : "",
+            i->second.flags & GENE_FROZEN ? ", frozen" : "");
+}
+
+Lineage::Lineage()
+    : m_records(NULL), m_diffs(NULL), m_nextId(0), m_clock(0),
+      m_diffOffset(0), m_stopping(false) {
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_changed, NULL);
+}
+
+Lineage::~Lineage() {
+    close();
+    pthread_mutex_destroy(&m_lock);
+    pthread_cond_destroy(&m_changed);
+}
+
+/**
+ * Start a lineage log, and its writer thread.
+ * 
+ * @param filename  the name of the log; the diffs go to filename.diffs
+ * @return          false if the files could not be created
+ */
+bool Lineage::open(const char *filename) {
+    std::string diffsFile = std::string(filename) + ".diffs";
+    m_records = fopen(filename, "wb");
+    if(m_records) m_diffs = fopen(diffsFile.c_str(), "wb");
+    if(!m_records || !m_diffs) {
+        perror(m_records ? diffsFile.c_str() : filename);
+        if(m_records) fclose(m_records);
+        m_records = NULL;
+        return false;
+    }
+    LineageHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = LINEAGE_MAGIC;
+    header.version = LINEAGE_VERSION;
+    header.recordSize = sizeof(LineageRecord);
+    header.numTraitParams = NEAT::num_trait_params;
+    m_recordBuffer.append((const char *) &header, sizeof(header));
+    m_stopping = false;
+    if(pthread_create(&m_writer, NULL, runWriter, this)) {
+        perror("pthread_create");
+        exit(1);
+    }
+    return true;
+}
+
+/**
+ * Record the end of every organism still alive, which must not have been
+ * deleted yet, then write out everything recorded, and stop the writer
+ * thread.
+ */
+void Lineage::close() {
+    if(!m_records) return;
+    std::vector<std::pair<int64_t, NEAT::Organism*> > survivors;
+    for(std::tr1::unordered_map<NEAT::Organism*, int64_t>::iterator
+        i = m_ids.begin(), e = m_ids.end(); i != e; i++)
+        survivors.push_back(std::make_pair(i->second, i->first));
+    std::sort(survivors.begin(), survivors.end()); // in order of birth
+    for(size_t i = 0; i < survivors.size(); i++)
+        end(survivors[i].second, survivors[i].first, LINEAGE_SURVIVED);
+    m_ids.clear();
+    flush();
+    pthread_mutex_lock(&m_lock);
+    m_stopping = true;
+    pthread_cond_broadcast(&m_changed);
+    pthread_mutex_unlock(&m_lock);
+    pthread_join(m_writer, NULL);
+    fclose(m_records);
+    fclose(m_diffs);
+    m_records = m_diffs = NULL;
+}
+
+/**
+ * Record an organism that has no recorded parents, such as one of the initial
+ * population.
+ * 
+ * @param organism  the rtNEAT organism
+ * @param clock     the number of offspring produced so far
+ */
+void Lineage::founder(NEAT::Organism *organism, int64_t clock) {
+    birth(organism, NULL, NULL, clock, false);
+}
+
+/**
+ * Record the birth of an organism.
+ * 
+ * @param organism  the rtNEAT organism
+ * @param mother    its first parent, which its genome is diffed against, or
+ *                  NULL for a founder
+ * @param father    its second parent, or NULL
+ * @param clock     the number of offspring produced so far
+ * @param inferred  true if the parents are a guess rather than known
+ */
+void Lineage::birth(NEAT::Organism *organism, NEAT::Organism *mother,
+                    NEAT::Organism *father, int64_t clock, bool inferred) {
+    if(!m_records) return;
+    m_clock = clock;
+    LineageRecord record;
+    memset(&record, 0, sizeof(record));
+    record.event = LINEAGE_BIRTH;
+    record.species = organism->species ? organism->species->id : -1;
+    record.id = m_nextId++;
+    record.clock = clock;
+    NEAT::Organism *parents[2] = { mother, father };
+    for(int i = 0; i < 2; i++) {
+        std::tr1::unordered_map<NEAT::Organism*, int64_t>::iterator
+            j = m_ids.find(parents[i]);
+        record.parents[i] = parents[i] && j != m_ids.end() ? j->second : -1;
+    }
+    LineageGenome child, parent;
+    child.assign(organism->gnome);
+    if(record.parents[0] >= 0) {
+        parent.assign(mother->gnome);
+        if(organism->mate_baby) record.flags |= LINEAGE_MATED;
+        if(organism->mut_struct_baby) record.flags |= LINEAGE_MUTATED;
+        if(inferred) record.flags |= LINEAGE_INFERRED;
+    } else {
+        record.flags |= LINEAGE_FOUNDER;
+    }
+    std::string diff;
+    child.diff(parent, diff);
+    m_ids[organism] = record.id;
+    append(record, diff);
+}
+
+/**
+ * Record the death of an organism, before it is deleted.
+ * 
+ * @param organism  the rtNEAT organism
+ * @param clock     the number of offspring produced so far
+ * @param rejected  true if it was rejected by screening without having lived
+ */
+void Lineage::death(NEAT::Organism *organism, int64_t clock, bool rejected) {
+    std::tr1::unordered_map<NEAT::Organism*, int64_t>::iterator
+        i = m_ids.find(organism);
+    if(!m_records || i == m_ids.end()) return;
+    m_clock = clock;
+    end(organism, i->second, rejected ? LINEAGE_REJECTED : 0);
+    m_ids.erase(i);
+}
+
+/**
+ * Append the death record of an organism, with its final age and fitness.
+ */
+void Lineage::end(NEAT::Organism *organism, int64_t id, int flags) {
+    LineageRecord record;
+    memset(&record, 0, sizeof(record));
+    record.event = LINEAGE_DEATH;
+    record.flags = flags;
+    record.species = organism->species ? organism->species->id : -1;
+    record.id = id;
+    record.parents[0] = record.parents[1] = -1;
+    record.clock = m_clock;
+    record.diffOffset = -1;
+    record.timeAlive = organism->time_alive;
+    record.fitness = organism->fitness;
+    append(record, std::string());
+}
+
+/**
+ * Buffer a record and its diff, handing them to the writer when the buffer
+ * is full.
+ */
+void Lineage::append(LineageRecord &record, const std::string &diff) {
+    if(!diff.empty()) {
+        record.diffOffset = m_diffOffset;
+        record.diffLength = diff.size();
+        m_diffOffset += diff.size();
+        m_diffBuffer += diff;
+    }
+    m_recordBuffer.append((const char *) &record, sizeof(record));
+    if(m_recordBuffer.size() + m_diffBuffer.size() >= LINEAGE_BUFFER_SIZE)
+        flush();
+}
+
+/**
+ * Hand everything buffered to the writer thread.
+ */
+void Lineage::flush() {
+    pthread_mutex_lock(&m_lock);
+    if(m_pendingRecords.empty()) m_pendingRecords.swap(m_recordBuffer);
+    else m_pendingRecords += m_recordBuffer;
+    if(m_pendingDiffs.empty()) m_pendingDiffs.swap(m_diffBuffer);
+    else m_pendingDiffs += m_diffBuffer;
+    pthread_cond_broadcast(&m_changed);
+    pthread_mutex_unlock(&m_lock);
+    m_recordBuffer.clear();
+    m_diffBuffer.clear();
+}
+
+/**
+ * Main loop of the writer thread: write whatever has been handed over, until
+ * the log is closed. Diffs are written before the records referring to them.
+ */
+void *Lineage::runWriter(void *arg) {
+    Lineage *lineage = (Lineage *) arg;
+    std::string records, diffs;
+    pthread_mutex_lock(&lineage->m_lock);
+    while(true) {
+        while(lineage->m_pendingRecords.empty() && !lineage->m_stopping)
+            pthread_cond_wait(&lineage->m_changed, &lineage->m_lock);
+        if(lineage->m_pendingRecords.empty()) break; // stopping
+        records.swap(lineage->m_pendingRecords);
+        diffs.swap(lineage->m_pendingDiffs);
+        pthread_mutex_unlock(&lineage->m_lock);
+        fwrite(diffs.data(), 1, diffs.size(), lineage->m_diffs);
+        fflush(lineage->m_diffs);
+        fwrite(records.data(), 1, records.size(), lineage->m_records);
+        fflush(lineage->m_records);
+        records.clear();
+        diffs.clear();
+        pthread_mutex_lock(&lineage->m_lock);
+    }
+    pthread_mutex_unlock(&lineage->m_lock);
+    return NULL;
+}
+
+/**
+ * Map a file read-only.
+ */
+static const char *mapFile(const char *filename, size_t &size) {
+    int fd = ::open(filename, O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) < 0) {
+        perror(filename);
+        if(fd >= 0) ::close(fd);
+        return NULL;
+    }
+    size = st.st_size;
+    void *map = size ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0)
+                     : MAP_FAILED;
+    ::close(fd);
+    return map == MAP_FAILED ? NULL : (const char *) map;
+}
+
+LineageReader::LineageReader()
+    : m_data(NULL), m_size(0), m_diffData(NULL), m_diffSize(0),
+      m_numTraitParams(0) {}
+
+LineageReader::~LineageReader() {
+    if(m_data) munmap((void *) m_data, m_size);
+    if(m_diffData) munmap((void *) m_diffData, m_diffSize);
+}
+
+/**
+ * Map a lineage log and its diffs, and index the births and deaths. A
+ * partly written record at the end is ignored.
+ * 
+ * @param filename  the name of the log
+ * @return          false if the file is not a readable lineage log
+ */
+bool LineageReader::open(const char *filename) {
+    m_data = mapFile(filename, m_size);
+    if(!m_data) return false;
+    const LineageHeader *h = (const LineageHeader *) m_data;
+    if(m_size < sizeof(LineageHeader)
+       || h->magic != LINEAGE_MAGIC || h->version != LINEAGE_VERSION
+       || h->recordSize != sizeof(LineageRecord) || h->numTraitParams < 0) {
+        fprintf(stderr, "%s: not a lineage log\n", filename);
+        return false;
+    }
+    m_numTraitParams = h->numTraitParams;
+    std::string diffsFile = std::string(filename) + ".diffs";
+    m_diffData = mapFile(diffsFile.c_str(), m_diffSize); // empty if no diffs
+    
+    for(int64_t i = 0; i < numRecords(); i++) {
+        const LineageRecord *r = record(i);
+        if(r->event == LINEAGE_BIRTH && r->id == (int64_t) m_births.size()) {
+            m_births.push_back(i);
+            m_deaths.push_back(-1);
+        } else if(r->event == LINEAGE_DEATH && r->id >= 0
+                  && r->id < (int64_t) m_deaths.size()) {
+            m_deaths[r->id] = i;
+        } else {
+            fprintf(stderr, "%s: record %lld is corrupt\n", filename,
+                (long long) i);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Return the number of organisms born.
+ * 
+ * @return  the number of organisms
+ */
+int64_t LineageReader::numOrganisms() {
+    return m_births.size();
+}
+
+/**
+ * Return the number of complete records.
+ * 
+ * @return  the number of records
+ */
+int64_t LineageReader::numRecords() {
+    return (m_size - sizeof(LineageHeader)) / sizeof(LineageRecord);
+}
+
+/**
+ * Return the i-th record.
+ * 
+ * @param i  the index of the record
+ * @return   the record
+ */
+const LineageRecord *LineageReader::record(int64_t i) {
+    return (const LineageRecord *) (m_data + sizeof(LineageHeader))
+        + i;
+}
+
+/**
+ * Return the birth record of the given organism.
+ * 
+ * @param id  the organism
+ * @return    the record, or NULL if there is no such organism
+ */
+const LineageRecord *LineageReader::birth(int64_t id) {
+    if(id < 0 || id >= numOrganisms()) return NULL;
+    return record(m_births[id]);
+}
+
+/**
+ * Return the death record of the given organism.
+ * 
+ * @param id  the organism
+ * @return    the record, or NULL if it was still alive
+ */
+const LineageRecord *LineageReader::death(int64_t id) {
+    if(id < 0 || id >= numOrganisms() || m_deaths[id] < 0) return NULL;
+    return record(m_deaths[id]);
+}
+
+/**
+ * Follow the first parents of the given organism back to a founder.
+ * 
+ * @param id     the organism
+ * @param chain  set to the organism followed by its ancestors
+ */
+void LineageReader::ancestors(int64_t id, std::vector<int64_t> &chain) {
+    chain.clear();
+    for(const LineageRecord *r = birth(id); r; r = birth(r->parents[0])) {
+        chain.push_back(r->id);
+        if(r->parents[0] >= r->id) break; // parents are always older
+    }
+}
+
+/**
+ * Reconstruct the genome of the given organism by applying the diffs along
+ * its line of first parents, starting from its founder.
+ * 
+ * @param id      the organism
+ * @param genome  set to the organism's genome
+ * @return        false if the organism or a diff is missing
+ */
+bool LineageReader::genome(int64_t id, LineageGenome &genome) {
+    std::vector<int64_t> chain;
+    ancestors(id, chain);
+    genome = LineageGenome();
+    if(chain.empty() || birth(chain.back())->parents[0] >= 0) return false;
+    for(size_t i = chain.size(); i-- > 0; ) {
+        const LineageRecord *r = birth(chain[i]);
+        if(r->diffLength == 0) continue; // identical to its parent
+        if(r->diffOffset < 0
+           || (uint64_t) r->diffOffset + r->diffLength > m_diffSize
+           || !genome.apply(m_diffData + r->diffOffset, r->diffLength,
+                            m_numTraitParams))
+            return false;
+    }
+    return true;
+}
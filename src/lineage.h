@@ -0,0 +1,201 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#ifndef LINEAGE_H
+#define LINEAGE_H
+
+#include <stdint.h>
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <tr1/unordered_map>
+#include <vector>
+
+#include <pthread.h>
+
+#include <NEAT/genome.h>
+#include <NEAT/organism.h>
+
+#define LINEAGE_MAGIC 0x4e494c4e /* "NLIN" */
+#define LINEAGE_VERSION 2
+#define LINEAGE_BUFFER_SIZE 65536
+
+/** Kinds of lineage record */
+enum LineageEvent {
+    LINEAGE_BIRTH,
+    LINEAGE_DEATH
+};
+
+/** Flags of a lineage record */
+enum LineageFlag {
+    LINEAGE_FOUNDER = 1,  /* born without parents, diffed against nothing */
+    LINEAGE_MATED = 2,    /* the offspring of two parents */
+    LINEAGE_MUTATED = 4,  /* structurally mutated */
+    LINEAGE_REJECTED = 8, /* died in screening, never having lived */
+    LINEAGE_INFERRED = 16, /* parents guessed from genome compatibility */
+    LINEAGE_SURVIVED = 32  /* still alive when the log was closed */
+};
+
+/**
+ * The header at the start of a lineage log. It is followed by fixed-size
+ * LineageRecords; the genome diffs they refer to go to a companion file with
+ * the same name plus ".diffs".
+ */
+struct LineageHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    int32_t numTraitParams;
+};
+
+/**
+ * A birth or death. Organisms are numbered in order of birth, founders
+ * first, so the n-th birth record is that of organism n.
+ */
+struct LineageRecord {
+    uint8_t event;
+    uint8_t flags;
+    uint16_t pad;
+    /** Species of the organism at the time */
+    int32_t species;
+    /** The organism, and its parents (-1 for none) */
+    int64_t id;
+    int64_t parents[2];
+    /** Offspring produced so far, which serves as the clock */
+    int64_t clock;
+    /** On birth, the genome's diff from the first parent */
+    int64_t diffOffset;
+    uint32_t diffLength;
+    /** On death, the final age and fitness */
+    int32_t timeAlive;
+    float fitness;
+    uint32_t pad2;
+};
+
+/**
+ * A genome reduced to what a diff can express: traits, nodes and genes keyed
+ * by id and innovation number. Only assign() touches rtNEAT; a diff is
+ * applied using the number of trait parameters recorded in the log's header,
+ * so logs stay readable whatever rtNEAT was built with.
+ */
+struct LineageGenome {
+    struct Node {
+        int flags;
+        int trait;
+    };
+    struct Gene {
+        int in, out;
+        int flags;
+        int trait;
+        float weight;
+        float mutation;
+    };
+    
+    std::map<int, std::vector<float> > traits;
+    std::map<int, Node> nodes;
+    std::map<unsigned long long, Gene> genes;
+    
+    void assign(NEAT::Genome *genome);
+    void diff(const LineageGenome &parent, std::string &out) const;
+    bool apply(const char *data, size_t length, int numTraitParams);
+    void print(FILE *file) const;
+};
+
+/**
+ * Appends a record of every birth and death in a population to a lineage
+ * log. Each birth stores only how the genome differs from its first parent.
+ * Records are buffered, and written by a background thread so that the
+ * population never waits for the disk.
+ */
+class Lineage {
+public:
+    Lineage();
+    ~Lineage();
+    bool open(const char *filename);
+    void close();
+    void founder(NEAT::Organism *organism, int64_t clock);
+    void birth(NEAT::Organism *organism, NEAT::Organism *mother,
+               NEAT::Organism *father, int64_t clock, bool inferred);
+    void death(NEAT::Organism *organism, int64_t clock, bool rejected);
+    
+protected:
+    /** The output files, or NULL if closed */
+    FILE *m_records;
+    FILE *m_diffs;
+    /** Number of each organism still alive */
+    std::tr1::unordered_map<NEAT::Organism*, int64_t> m_ids;
+    int64_t m_nextId;
+    /** The latest clock reported */
+    int64_t m_clock;
+    /** Bytes of diffs produced */
+    int64_t m_diffOffset;
+    /** Records and diffs not yet handed to the writer */
+    std::string m_recordBuffer;
+    std::string m_diffBuffer;
+    
+    /** Background writer */
+    pthread_t m_writer;
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_changed;
+    /** Data handed to the writer, guarded by m_lock */
+    std::string m_pendingRecords;
+    std::string m_pendingDiffs;
+    bool m_stopping;
+    
+    void end(NEAT::Organism *organism, int64_t id, int flags);
+    void append(LineageRecord &record, const std::string &diff);
+    void flush();
+    static void *runWriter(void *lineage);
+};
+
+/**
+ * Reads a lineage log by mapping it and its diffs into memory. Opening scans
+ * the fixed-size records once to index each organism's birth and death.
+ */
+class LineageReader {
+public:
+    LineageReader();
+    ~LineageReader();
+    bool open(const char *filename);
+    int64_t numOrganisms();
+    int64_t numRecords();
+    const LineageRecord *record(int64_t i);
+    const LineageRecord *birth(int64_t id);
+    const LineageRecord *death(int64_t id);
+    void ancestors(int64_t id, std::vector<int64_t> &chain);
+    bool genome(int64_t id, LineageGenome &genome);
+    
+protected:
+    /** The mapped files */
+    const char *m_data;
+    size_t m_size;
+    const char *m_diffData;
+    size_t m_diffSize;
+    /** Number of trait parameters in the genomes */
+    int m_numTraitParams;
+    /** Record index of each organism's birth and death (-1 while alive) */
+    std::vector<int64_t> m_births;
+    std::vector<int64_t> m_deaths;
+};
+
+#endif
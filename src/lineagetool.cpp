@@ -0,0 +1,164 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+// rtneatbox-lineage: explore a lineage log recorded by rtneatbox (see the -l
+// option): summarise it, follow an organism's ancestors back to a founder, or
+// reconstruct its genome.
+
+#include "lineage.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+/** Totals for one species */
+struct SpeciesSummary {
+    int64_t births, deaths, rejected, survived;
+    double totalFitness, bestFitness;
+    
+    SpeciesSummary()
+        : births(0), deaths(0), rejected(0), survived(0), totalFitness(0),
+          bestFitness(0) {}
+};
+
+void usage(const char *name) {
+    printf("Usage: %s lineage [ancestors id | genome id]\n", name);
+    printf("With no command, summarise births and deaths by species.\n");
+    printf("Commands:\n");
+    printf("\tancestors id\tlist the organism's line of first parents\n");
+    printf("\tgenome id\treconstruct the organism's genome\n");
+}
+
+/**
+ * Print totals for the whole log and for each species.
+ */
+void printSummary(LineageReader &reader) {
+    std::map<int, SpeciesSummary> species;
+    int64_t founders = 0, mated = 0, mutated = 0;
+    for(int64_t i = 0; i < reader.numRecords(); i++) {
+        const LineageRecord *r = reader.record(i);
+        SpeciesSummary &s = species[r->species];
+        if(r->event == LINEAGE_BIRTH) {
+            s.births++;
+            if(r->flags & LINEAGE_FOUNDER) founders++;
+            if(r->flags & LINEAGE_MATED) mated++;
+            if(r->flags & LINEAGE_MUTATED) mutated++;
+        } else if(r->flags & LINEAGE_REJECTED) {
+            s.rejected++;
+        } else if(r->flags & LINEAGE_SURVIVED) {
+            s.survived++;
+        } else {
+            s.deaths++;
+            s.totalFitness += r->fitness;
+            if(s.deaths == 1 || r->fitness > s.bestFitness)
+                s.bestFitness = r->fitness;
+        }
+    }
+    int64_t deaths = 0, survived = 0;
+    for(std::map<int, SpeciesSummary>::iterator
+        i = species.begin(), e = species.end(); i != e; i++) {
+        deaths += i->second.deaths + i->second.rejected;
+        survived += i->second.survived;
+    }
+    // logs that weren't closed cleanly have no survivor records
+    printf("%lld organisms: %lld founders, %lld mated, %lld structurally "
+           "mutated; %lld survived, %lld unaccounted for\n",
+           (long long) reader.numOrganisms(), (long long) founders,
+           (long long) mated, (long long) mutated, (long long) survived,
+           (long long) (reader.numOrganisms() - deaths - survived));
+    printf("%-8s %10s %10s %10s %10s %12s %12s\n", "species", "births",
+        "deaths", "rejected", "survived", "mean final", "best final");
+    for(std::map<int, SpeciesSummary>::iterator
+        i = species.begin(), e = species.end(); i != e; i++) {
+        SpeciesSummary &s = i->second;
+        printf("%-8d %10lld %10lld %10lld %10lld %12.4g %12.4g\n",
+            i->first, (long long) s.births, (long long) s.deaths,
+            (long long) s.rejected, (long long) s.survived,
+            s.deaths ? s.totalFitness / s.deaths : 0.0, s.bestFitness);
+    }
+}
+
+/**
+ * Print the given organism and its line of first parents, one per line.
+ */
+void printAncestors(LineageReader &reader, int64_t id) {
+    std::vector<int64_t> chain;
+    reader.ancestors(id, chain);
+    printf("%10s %10s %8s %10s %6s %10s %12s %6s\n", "id", "born",
+        "species", "father", "how", "died", "final", "diff");
+    for(size_t i = 0; i < chain.size(); i++) {
+        const LineageRecord *b = reader.birth(chain[i]);
+        const LineageRecord *d = reader.death(chain[i]);
+        char how[7] = "------";
+        if(b->flags & LINEAGE_FOUNDER) how[0] = 'F';
+        if(b->flags & LINEAGE_MATED) how[1] = 'X';
+        if(b->flags & LINEAGE_MUTATED) how[2] = 'S';
+        if(b->flags & LINEAGE_INFERRED) how[3] = 'I';
+        if(d && (d->flags & LINEAGE_REJECTED)) how[4] = 'R';
+        if(d && (d->flags & LINEAGE_SURVIVED)) how[5] = 'L';
+        printf("%10lld %10lld %8d %10lld %6s", (long long) b->id,
+            (long long) b->clock, b->species, (long long) b->parents[1], how);
+        if(d) printf(" %10lld %12.4g", (long long) d->clock, d->fitness);
+        else printf(" %10s %12s", "alive", "-");
+        printf(" %6u\n", b->diffLength);
+    }
+    printf("how: F founder, X mated, S structural mutation, "
+           "I parents inferred, R rejected by screening, L alive at end\n");
+    printf("Inferred parents are the most compatible genomes in the parent "
+           "species at birth,\nso the line may pass through a sibling or "
+           "cousin of the true parent.\n");
+}
+
+int main(int argc, char **argv) {
+    if(argc != 2 && argc != 4) {
+        usage(argv[0]);
+        return 1;
+    }
+    LineageReader reader;
+    if(!reader.open(argv[1])) return 1;
+    if(argc == 2) {
+        printSummary(reader);
+        return 0;
+    }
+    int64_t id = atoll(argv[3]);
+    if(!reader.birth(id)) {
+        fprintf(stderr, "no organism %lld\n", (long long) id);
+        return 1;
+    }
+    if(strcmp(argv[2], "ancestors") == 0) {
+        printAncestors(reader, id);
+    } else if(strcmp(argv[2], "genome") == 0) {
+        LineageGenome genome;
+        if(!reader.genome(id, genome)) {
+            fprintf(stderr, "the diffs for organism %lld are incomplete\n",
+                (long long) id);
+            return 1;
+        }
+        genome.print(stdout);
+    } else {
+        usage(argv[0]);
+        return 1;
+    }
+    return 0;
+}
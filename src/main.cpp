@@ -21,10 +21,29 @@
 */
 
 #include "level.h"
+#include "archive.h"
+#include "debugdraw.h"
+#include "farm.h"
+#include "governor.h"
+#include "lineage.h"
+#include "multilevel.h"
+#include "organism.h"
+#include "params.h"
+#include "population.h"
+#include "sandbox.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "trace.h"
 
+#include <cmath>
 #include <cstdlib>
 #include <ctime>
 #include <cstdio>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <unistd.h>
 
 #include <NEAT/neat.h>
 #include <GL/glut.h>
@@ -33,17 +52,140 @@
 
 static int mainWindow;
 static Level *level;
+static MultiLevel *multiLevel;
+static Stats stats;
+static Archive archive;
+static Trace trace;
+static TraceReader replay;
+static Lineage lineage;
+static Snapshot replaySnapshot;
+static SnapshotBuffer snapshots;
+static DebugDraw debugDraw;
+static pthread_t simulationThread;
+/** Should the simulation run as fast as possible rather than in real time? */
+static volatile bool fastForward = false;
+static volatile bool stopping = false;
+/** Replayed range in ticks, current position and ticks per frame */
+static int64_t replayFrom, replayTo;
+static double replayPosition, replaySpeed = 1.0;
+static bool replayPaused = false;
 static b2Vec2 viewCenter(0.0, 0.0);
 static double viewZoom = 1.0;
 
+/**
+ * Main loop of the simulation thread: step the level in real time, or as fast
+ * as possible when fast-forwarding, until the program exits.
+ */
+void *simulate(void *) {
+    double next = statsClock();
+    while(!stopping) {
+        if(multiLevel) multiLevel->step();
+        else level->step();
+        next += 1.0 / FRAME_RATE;
+        double now = statsClock();
+        if(fastForward || now > next + 0.25) next = now; // don't catch up
+        else if(next > now) usleep((useconds_t) ((next - now) * 1e6));
+    }
+    return NULL;
+}
+
+void stopSimulation() {
+    stopping = true;
+    pthread_join(simulationThread, NULL);
+}
+
+/**
+ * Draw the newest snapshot published by the simulation thread.
+ */
 void display() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
-    level->step();
+    const Snapshot *snapshot = snapshots.acquire();
+    if(snapshot->tick >= 0) {
+        drawSnapshot(debugDraw, snapshots.ground(), *snapshot);
+        if(fastForward)
+            DrawString(5, 15, "t=%.1fs  (fast forward)",
+                (double) snapshot->tick / FRAME_RATE);
+    }
     glutSwapBuffers();
 }
 
+/**
+ * Controls: f toggles fast-forwarding.
+ */
+void keyboard(unsigned char key, int, int) {
+    if(key == 'f') fastForward = !fastForward;
+}
+
+/**
+ * Draw the next frame of a replayed trace, decoding forward where possible
+ * and seeking otherwise.
+ */
+void replayDisplay() {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    if(!replayPaused) {
+        replayPosition += replaySpeed;
+        double length = replayTo - replayFrom + 1;
+        while(replayPosition >= replayTo + 1) replayPosition -= length;
+        while(replayPosition < replayFrom) replayPosition += length;
+    }
+    int64_t tick = (int64_t) replayPosition;
+    int64_t ahead = tick - replay.frame().tick;
+    if(ahead > 0 && ahead < TRACE_KEYFRAME_PERIOD)
+        while(replay.frame().tick < tick && replay.next());
+    else if(ahead != 0)
+        replay.seek(tick);
+    
+    replaySnapshot.tick = replay.frame().tick;
+    replaySnapshot.goal = replay.goal();
+    replaySnapshot.bodies.resize(replay.header()->numSlots);
+    for(int i = 0; i < replay.header()->numSlots; i++) {
+        SnapshotBody &b = replaySnapshot.bodies[i];
+        b2Vec2 p = replay.position(i), v = replay.velocity(i);
+        b.x = p.x;
+        b.y = p.y;
+        b.angle = atan2(v.y, v.x); // the trace has no angles, so face forward
+        b.sleeping = false;
+    }
+    drawSnapshot(debugDraw, replay.ground(), replaySnapshot);
+    DrawString(5, 15, "%s  t=%.1fs  speed %gx%s", replay.header()->level,
+        (double) replay.frame().tick / FRAME_RATE, replaySpeed,
+        replayPaused ? "  (paused)" : "");
+    glutSwapBuffers();
+}
+
+/**
+ * Replay controls: space pauses, + and - change the speed, r reverses, and
+ * [ and ] skip back and forward by ten seconds.
+ */
+void replayKeyboard(unsigned char key, int, int) {
+    switch(key) {
+    case ' ': replayPaused = !replayPaused; break;
+    case '+': case '=': replaySpeed *= 2; break;
+    case '-': replaySpeed /= 2; break;
+    case 'r': replaySpeed = -replaySpeed; break;
+    case '[': replayPosition -= 10 * FRAME_RATE; break;
+    case ']': replayPosition += 10 * FRAME_RATE; break;
+    }
+    if(replayPosition < replayFrom) replayPosition = replayFrom;
+    if(replayPosition > replayTo) replayPosition = replayTo;
+}
+
+void closeTrace() {
+    trace.close();
+}
+
+void closeLineage() {
+    // wait for any birth being logged in the background, then record the
+    // survivors
+    if(multiLevel) multiLevel->setLineage(NULL);
+    else level->getPopulation()->setLineage(NULL);
+    lineage.close();
+}
+
 void resize(int width, int height) {
     glViewport(0, 0, width, height);
     glMatrixMode(GL_PROJECTION);
@@ -62,24 +204,190 @@ void timer(int) {
     glutTimerFunc(FRAME_PERIOD, timer, 0);
 }
 
+void usage(const char *name) {
+    printf("Usage: %s [-e] [-c error] [-n weight] [-s statsfile] "
+           "[-w workers] [-a archive [-i]] [-p name=value,...] "
+           "[-o trace] [-g] [-l lineage] level [level...]\n", name);
+    printf("       %s -r trace [from [to]]\n", name);
+    printf("Must specify a level file to load, e.g.:\n");
+    printf("\t%s data/peak.lvl\n", name);
+    printf("\t%s data/climb.lvl\n", name);
+    printf("Several levels evaluate every genome on each of them at once.\n");
+    printf("Options:\n");
+    printf("\t-e\t\tterminate hopeless evaluations early\n");
+    printf("\t-c error\tsense incrementally, with the given error bound "
+           "in metres (0 for exact)\n");
+    printf("\t-n weight\tscore by novelty, blended with the goal score "
+           "(1 for pure novelty)\n");
+    printf("\t-s statsfile\tpublish live statistics for rtneatbox-top\n");
+    printf("\t-w workers\tevaluate headless in forked worker processes\n");
+    printf("\t-a archive\trecord champions in a hall of fame archive\n");
+    printf("\t-i\t\tseed the population from the archive\n");
+    printf("\t-p name=value\toverride parameters, e.g. -p pop_size=100,"
+           "mutate_add_link_prob=0.1\n");
+    printf("\t-o trace\trecord trajectories for replay\n");
+    printf("\t-r trace\treplay recorded trajectories, optionally between "
+           "the given times in seconds\n");
+    printf("\t-g\t\thold real time by lowering fidelity when ticks run "
+           "long\n");
+    printf("\t-l lineage\tlog every birth and death, with genome diffs, for "
+           "rtneatbox-lineage\n");
+}
+
+/**
+ * Attach the archive to the given population, seeding it if requested.
+ */
+void useArchive(Population *population, bool seed) {
+    population->archive = &archive;
+    if(!seed) return;
+    std::vector<NEAT::Genome*> genomes;
+    if(archive.best(NEAT::pop_size, genomes) == 0)
+        archive.best(NEAT::pop_size, genomes, true); // try other levels
+    printf("seeding population from %d archived genomes\n",
+        (int) genomes.size());
+    population->seed(genomes);
+    for(size_t i = 0; i < genomes.size(); i++)
+        delete genomes[i];
+}
+
 int main(int argc, char **argv) {
-    if(argc <= 1) {
-        printf("Must specify a level file to load, e.g.:\n");
-        printf("\t%s data/peak.lvl\n", argv[0]);
-        printf("\t%s data/climb.lvl\n", argv[0]);
+    const char *statsFile = NULL;
+    const char *archiveFile = NULL;
+    bool seed = false;
+    bool governed = false;
+    double noveltyWeight = 0;
+    const char *assignments = NULL;
+    const char *traceFile = NULL;
+    const char *lineageFile = NULL;
+    const char *replayFile = NULL;
+    int numWorkers = 0;
+    int opt;
+    while((opt = getopt(argc, argv, "ec:n:s:w:a:ip:o:r:gl:")) != -1) {
+        switch(opt) {
+        case 'e': Organism::termination.enabled = true; break;
+        case 'c':
+            Organism::sensing.incremental = true;
+            Organism::sensing.errorBound = atof(optarg);
+            break;
+        case 'n': noveltyWeight = atof(optarg); break;
+        case 's': statsFile = optarg; break;
+        case 'w': numWorkers = atoi(optarg); break;
+        case 'a': archiveFile = optarg; break;
+        case 'i': seed = true; break;
+        case 'p': assignments = optarg; break;
+        case 'o': traceFile = optarg; break;
+        case 'r': replayFile = optarg; break;
+        case 'g': governed = true; break;
+        case 'l': lineageFile = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if(replayFile) {
+        if(!replay.open(replayFile)) return 1;
+        replayFrom = optind < argc ? atof(argv[optind]) * FRAME_RATE : 0;
+        replayTo = optind + 1 < argc ? atof(argv[optind + 1]) * FRAME_RATE
+                                     : replay.lastTick();
+        if(replayTo > replay.lastTick()) replayTo = replay.lastTick();
+        if(replayFrom > replayTo) replayFrom = replayTo;
+        replay.seek(replayFrom);
+        replayPosition = replayFrom;
+        glutInit(&argc, argv);
+        glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE);
+        glutInitWindowSize(640, 480);
+        mainWindow = glutCreateWindow("rtNEATbox replay");
+        glutDisplayFunc(replayDisplay);
+        glutKeyboardFunc(replayKeyboard);
+        glutReshapeFunc(resize);
+        glutTimerFunc(FRAME_PERIOD, timer, 0);
+        glutMainLoop();
+        return 0;
+    }
+    if(optind >= argc) {
+        usage(argv[0]);
         return 1;
     }
+    const char *levelFile = argv[optind];
+    std::vector<std::string> levelFiles(argv + optind, argv + argc);
     
     srand(time(NULL));
     NEAT::load_neat_params("data/params.ne", DEBUG);
-    level = new Level(argv[1]);
+    if(assignments && !applyParams(assignments)) return 1;
+    if(noveltyWeight > 0) Organism::novelty = new Novelty(noveltyWeight);
+    if(archiveFile && !archive.open(archiveFile, levelFile)) return 1;
+    if(numWorkers > 0) {
+        if(levelFiles.size() > 1) {
+            fprintf(stderr, "only one level can be used with -w\n");
+            return 1;
+        }
+        if(Population::asyncEvolution) {
+            fprintf(stderr, "ASYNC_EVOLUTION is not available with -w\n");
+            return 1;
+        }
+        if(noveltyWeight > 0) { // each worker would keep its own archive
+            fprintf(stderr, "novelty is not available with -w\n");
+            return 1;
+        }
+        if(statsFile || traceFile || governed || lineageFile)
+            fprintf(stderr, "statistics, traces, the governor and lineage "
+                "logs are not available with -w\n");
+        Farm farm(levelFile, numWorkers);
+        if(archiveFile) useArchive(&farm, seed);
+        farm.run();
+        return 0;
+    }
+    if(levelFiles.size() > 1) {
+        if(statsFile || traceFile || noveltyWeight > 0 || governed) {
+            fprintf(stderr, "statistics, traces, novelty and the governor are "
+                "not available with several levels\n");
+            return 1;
+        }
+        if(Population::asyncEvolution) {
+            fprintf(stderr, "ASYNC_EVOLUTION is not available with several "
+                "levels\n");
+            return 1;
+        }
+        multiLevel = new MultiLevel(levelFiles);
+        level = multiLevel->getLevel(0);
+        if(archiveFile) useArchive(multiLevel, seed);
+    } else {
+        level = new Level(levelFile);
+        if(archiveFile) useArchive(level->getPopulation(), seed);
+        if(Population::screenBatch > 0)
+            level->getPopulation()->sandbox =
+                new Sandbox(levelFile, Population::screenBatch);
+    }
+    if(statsFile) {
+        if(!stats.open(statsFile, levelFile, NEAT::pop_size)) return 1;
+        level->setStats(&stats);
+    }
+    if(traceFile) {
+        if(!trace.open(traceFile, levelFile, level)) return 1;
+        level->setTrace(&trace);
+        atexit(closeTrace);
+    }
+    if(lineageFile) {
+        if(!lineage.open(lineageFile)) return 1;
+        if(multiLevel) multiLevel->setLineage(&lineage);
+        else level->getPopulation()->setLineage(&lineage);
+        atexit(closeLineage);
+    }
+    if(governed)
+        level->setGovernor(new Governor(level, GOVERNOR_BUDGET / FRAME_RATE));
+    snapshots.init(level);
+    level->setSnapshots(&snapshots);
     
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE);
     glutInitWindowSize(640, 480);
     mainWindow = glutCreateWindow("rtNEATbox");
     glutDisplayFunc(display);
+    glutKeyboardFunc(keyboard);
     glutReshapeFunc(resize);
+    if(pthread_create(&simulationThread, NULL, simulate, NULL)) {
+        perror("pthread_create");
+        return 1;
+    }
+    atexit(stopSimulation); // runs before closeTrace and closeLineage
     glutTimerFunc(FRAME_PERIOD, timer, 0);
     glutMainLoop();
     
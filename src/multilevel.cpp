@@ -0,0 +1,186 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#include "multilevel.h"
+#include "arena.h"
+#include "level.h"
+#include "organism.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <NEAT/neat.h>
+
+/**
+ * Load the given levels and start a thread for each but the first.
+ * 
+ * @param levelFiles  the names of the files describing the levels
+ */
+MultiLevel::MultiLevel(const std::vector<std::string> &levelFiles)
+    : Population(NULL, Level::readLifetime(levelFiles[0].c_str())),
+      m_worlds(levelFiles.size()), m_stopping(false) {
+    evolve = true;
+    int lifetime = NEAT::time_alive_minimum;
+    for(size_t w = 0; w < m_worlds.size(); w++) {
+        World &world = m_worlds[w];
+        world.owner = this;
+        world.level = new Level(levelFiles[w].c_str());
+        world.level->getPopulation()->evolve = false;
+        world.owned.assign(NEAT::pop_size, (NEAT::Organism *) NULL);
+    }
+    setLifetime(lifetime); // each level's own population set its lifetime
+    for(int i = 0; i < NEAT::pop_size; i++)
+        mirror(i);
+    
+    pthread_barrier_init(&m_start, NULL, m_worlds.size());
+    pthread_barrier_init(&m_done, NULL, m_worlds.size());
+    for(size_t w = 1; w < m_worlds.size(); w++) {
+        if(pthread_create(&m_worlds[w].thread, NULL, runWorld, &m_worlds[w])) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+}
+
+MultiLevel::~MultiLevel() {
+    if(m_ticksSinceEvolution > 0) // let the other levels finish the period
+        pthread_barrier_wait(&m_done);
+    m_stopping = true;
+    pthread_barrier_wait(&m_start);
+    for(size_t w = 1; w < m_worlds.size(); w++)
+        pthread_join(m_worlds[w].thread, NULL);
+    pthread_barrier_destroy(&m_start);
+    pthread_barrier_destroy(&m_done);
+    for(size_t w = 0; w < m_worlds.size(); w++) {
+        delete m_worlds[w].level;
+        for(int i = 0; i < NEAT::pop_size; i++)
+            delete m_worlds[w].owned[i];
+    }
+}
+
+/**
+ * Step the first level forward by one timestep. At the end of an evolution
+ * period, wait for the other levels to finish theirs, then evolve.
+ */
+void MultiLevel::step() {
+    if(m_ticksSinceEvolution == 0)
+        pthread_barrier_wait(&m_start);
+    m_worlds[0].level->step();
+    if(++m_ticksSinceEvolution < m_evolutionSpacing) return;
+    pthread_barrier_wait(&m_done);
+    // the other threads are now parked at m_start until the next step
+    gather();
+    if(evolve) evolvePopulation();
+    m_ticksSinceEvolution = 0;
+}
+
+/**
+ * Return the i-th level.
+ * 
+ * @param i  the index of the level
+ * @return   the level
+ */
+Level *MultiLevel::getLevel(int i) {
+    return m_worlds[i].level;
+}
+
+/**
+ * Return the work done by the organisms so far, summed over the levels. The
+ * other levels' threads must be waiting for the next evolution period.
+ * 
+ * @param counters  set to the sum of the levels' counters
+ */
+void MultiLevel::getCounters(EvaluationCounters &counters) {
+    counters = EvaluationCounters();
+    for(size_t w = 0; w < m_worlds.size(); w++)
+        counters.add(m_worlds[w].level->counters);
+}
+
+/**
+ * Replace an rtNEAT organism, copying the new one into every level.
+ * 
+ * @param oldOrganism  the rtNEAT organism to replace
+ * @param newOrganism  the new rtNEAT organism
+ */
+void MultiLevel::replaceOrganism(NEAT::Organism *oldOrganism,
+                                 NEAT::Organism *newOrganism) {
+    int slot = slotOf(oldOrganism);
+    if(slot < 0) return;
+    bind(slot, newOrganism);
+    mirror(slot);
+}
+
+/**
+ * Give every level its own copy of the organism in the given slot, with its
+ * own network, fitness and age.
+ * 
+ * @param slot  the slot
+ */
+void MultiLevel::mirror(int slot) {
+    NEAT::Organism *original = m_organisms[slot].getNEATOrganism();
+    for(size_t w = 0; w < m_worlds.size(); w++) {
+        World &world = m_worlds[w];
+        ArenaScope scope;
+        NEAT::Organism *copy = new NEAT::Organism(0.0,
+            original->gnome->duplicate(original->gnome->genome_id), 0);
+        copy->fitness = original->fitness;
+        copy->time_alive = original->time_alive;
+        world.level->getPopulation()->setNEATOrganism(slot, copy);
+        delete world.owned[slot]; // the originals belong to each level
+        world.owned[slot] = copy;
+    }
+}
+
+/**
+ * Set the fitness of every rtNEAT organism to the mean of its copies'. The
+ * copies' own fitness and age are read, since those committed to their
+ * rtNEAT organisms lag until the next evaluation.
+ */
+void MultiLevel::gather() {
+    for(int i = 0; i < NEAT::pop_size; i++) {
+        double fitness = 0;
+        for(size_t w = 0; w < m_worlds.size(); w++)
+            fitness += m_worlds[w].level->getPopulation()
+                ->getOrganism(i)->getFitness();
+        NEAT::Organism *organism = m_organisms[i].getNEATOrganism();
+        organism->fitness = fitness / m_worlds.size();
+        organism->time_alive = m_worlds[0].level->getPopulation()
+            ->getOrganism(i)->getTimeAlive();
+        reindex(i);
+    }
+}
+
+/**
+ * Main loop of the thread stepping one of the other levels: run an evolution
+ * period, then wait for the next one.
+ */
+void *MultiLevel::runWorld(void *arg) {
+    World *world = (World *) arg;
+    MultiLevel *owner = world->owner;
+    while(true) {
+        pthread_barrier_wait(&owner->m_start);
+        if(owner->m_stopping) return NULL;
+        for(int t = 0; t < owner->m_evolutionSpacing; t++)
+            world->level->step();
+        pthread_barrier_wait(&owner->m_done);
+    }
+}
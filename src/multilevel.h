@@ -0,0 +1,79 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#ifndef MULTILEVEL_H
+#define MULTILEVEL_H
+
+#include "population.h"
+
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+/**
+ * A population evaluated on several levels at once, so that fitness rewards
+ * genomes that generalise rather than those that overfit a single map.
+ * 
+ * The MultiLevel owns the rtNEAT population. Every level hosts a full copy of
+ * the organisms, each with its own network, and is stepped on its own thread.
+ * The levels only synchronise at evolution events: each runs one evolution
+ * period's worth of ticks, then the fitness of every genome is averaged over
+ * the levels before the worst organism is removed, and the offspring is
+ * copied into every level. All levels share the lifetime of the first; each
+ * keeps its own early termination and sensing counters, which are summed.
+ */
+class MultiLevel : public Population {
+public:
+    MultiLevel(const std::vector<std::string> &levelFiles);
+    ~MultiLevel();
+    void step();
+    Level *getLevel(int i);
+    void getCounters(EvaluationCounters &counters);
+    
+protected:
+    /** A level and the copies of the organisms living in it */
+    struct World {
+        MultiLevel *owner;
+        Level *level;
+        /** The copy of each slot's rtNEAT organism owned by this world */
+        std::vector<NEAT::Organism*> owned;
+        pthread_t thread;
+    };
+    
+    /** The levels; the first is stepped by the caller of step() */
+    std::vector<World> m_worlds;
+    /** Releases the other levels into the next evolution period */
+    pthread_barrier_t m_start;
+    /** Waits for every level to finish the current evolution period */
+    pthread_barrier_t m_done;
+    /** Tells the other levels' threads to exit */
+    bool m_stopping;
+    
+    void replaceOrganism(NEAT::Organism *oldOrganism,
+                         NEAT::Organism *newOrganism);
+    void mirror(int slot);
+    void gather();
+    static void *runWorld(void *world);
+};
+
+#endif
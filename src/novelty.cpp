@@ -0,0 +1,261 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#include "novelty.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <NEAT/neat.h>
+
+#define D NOVELTY_DIMENSIONS
+
+typedef std::vector<std::pair<float, int> > Heap;
+
+static float distanceSquared(const float *a, const float *b) {
+    float sum = 0;
+    for(int i = 0; i < D; i++)
+        sum += (a[i] - b[i]) * (a[i] - b[i]);
+    return sum;
+}
+
+/**
+ * Offer a candidate to a max-heap of the k nearest neighbours found so far.
+ * 
+ * @param heap      the heap, keyed on squared distance
+ * @param k         the number of neighbours wanted
+ * @param distance  the squared distance of the candidate
+ * @param index     the index of the candidate
+ */
+static void offer(Heap &heap, int k, float distance, int index) {
+    if((int) heap.size() < k) {
+        heap.push_back(std::make_pair(distance, index));
+        std::push_heap(heap.begin(), heap.end());
+    } else if(distance < heap.front().first) {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = std::make_pair(distance, index);
+        std::push_heap(heap.begin(), heap.end());
+    }
+}
+
+/** Orders point indices by one coordinate */
+struct ByAxis {
+    const float *points;
+    int axis;
+    bool operator()(int a, int b) const {
+        return points[a*D + axis] < points[b*D + axis];
+    }
+};
+
+KdTree::KdTree()
+    : m_root(-1) {}
+
+/**
+ * Insert a point into the tree.
+ * 
+ * @param point  the point, with NOVELTY_DIMENSIONS coordinates
+ */
+void KdTree::insert(const float *point) {
+    int index = m_nodes.size();
+    m_points.insert(m_points.end(), point, point + D);
+    Node node = { -1, -1, 1 };
+    m_nodes.push_back(node);
+    m_axes.push_back(0);
+    m_path.clear();
+    if(m_root < 0) {
+        m_root = index;
+        return;
+    }
+    int current = m_root;
+    while(true) {
+        m_path.push_back(current);
+        m_nodes[current].size++;
+        int axis = m_axes[current];
+        int &child = (point[axis] < m_points[current*D + axis]) ?
+            m_nodes[current].left : m_nodes[current].right;
+        if(child < 0) {
+            child = index;
+            m_axes[index] = (axis + 1) % D;
+            break;
+        }
+        current = child;
+    }
+    if(m_path.size() <= log((double) size()) / log(1.0 / KDTREE_BALANCE))
+        return;
+    // too deep, so some ancestor on the path must be out of balance
+    int child = index;
+    for(int i = m_path.size() - 1; i >= 0; i--) {
+        int n = m_path[i];
+        if(m_nodes[child].size > KDTREE_BALANCE * m_nodes[n].size) {
+            rebuild(n, i > 0 ? m_path[i-1] : -1, i);
+            return;
+        }
+        child = n;
+    }
+}
+
+/**
+ * Return the number of points in the tree.
+ * 
+ * @return  the number of points
+ */
+int KdTree::size() {
+    return m_nodes.size();
+}
+
+/**
+ * Find the k nearest points to the given point, merging them into a heap
+ * which may already hold other candidates.
+ * 
+ * @param point  the point
+ * @param k      the number of neighbours
+ * @param heap   max-heap of (squared distance, index) pairs
+ */
+void KdTree::nearest(const float *point, int k, Heap &heap) {
+    // iterative, since the tree may be deep enough between rebuilds to
+    // overflow the stack; each subtree waits with a lower bound on its
+    // distance and is skipped if the heap has filled with closer points
+    m_stack.clear();
+    if(m_root >= 0) m_stack.push_back(std::make_pair(0.0f, m_root));
+    while(!m_stack.empty()) {
+        float bound = m_stack.back().first;
+        int node = m_stack.back().second;
+        m_stack.pop_back();
+        if((int) heap.size() >= k && bound >= heap.front().first) continue;
+        const float *p = &m_points[node*D];
+        offer(heap, k, distanceSquared(point, p), node);
+        int axis = m_axes[node];
+        float delta = point[axis] - p[axis];
+        int nearSide = delta < 0 ? m_nodes[node].left : m_nodes[node].right;
+        int farSide = delta < 0 ? m_nodes[node].right : m_nodes[node].left;
+        if(farSide >= 0)
+            m_stack.push_back(std::make_pair(delta * delta, farSide));
+        if(nearSide >= 0) m_stack.push_back(std::make_pair(0.0f, nearSide));
+    }
+}
+
+/**
+ * Rebuild a subtree balanced, splitting at the median.
+ * 
+ * @param node    the root of the subtree
+ * @param parent  the parent of the root, or -1 if it is the tree's root
+ * @param depth   the depth of the root
+ */
+void KdTree::rebuild(int node, int parent, int depth) {
+    m_indices.clear();
+    m_indices.push_back(node);
+    for(size_t i = 0; i < m_indices.size(); i++) {
+        const Node &n = m_nodes[m_indices[i]];
+        if(n.left >= 0) m_indices.push_back(n.left);
+        if(n.right >= 0) m_indices.push_back(n.right);
+    }
+    int root = build(&m_indices[0], &m_indices[0] + m_indices.size(), depth);
+    if(parent < 0) m_root = root;
+    else if(m_nodes[parent].left == node) m_nodes[parent].left = root;
+    else m_nodes[parent].right = root;
+}
+
+int KdTree::build(int *first, int *last, int depth) {
+    if(first == last) return -1;
+    ByAxis byAxis = { &m_points[0], depth % D };
+    int *middle = first + (last - first) / 2;
+    std::nth_element(first, middle, last, byAxis);
+    int node = *middle;
+    m_axes[node] = byAxis.axis;
+    m_nodes[node].size = last - first;
+    m_nodes[node].left = build(first, middle, depth + 1);
+    m_nodes[node].right = build(middle + 1, last, depth + 1);
+    return node;
+}
+
+/**
+ * Create a novelty scorer.
+ * 
+ * @param weight  weight of novelty in the score, where 1.0 ignores the goal
+ */
+Novelty::Novelty(double weight)
+    : m_weight(weight), m_recent(NEAT::pop_size * D), m_numRecent(0),
+      m_nextRecent(0), m_threshold(NOVELTY_THRESHOLD), m_evaluations(0),
+      m_additions(0), m_meanNovelty(0), m_meanGoalScore(0) {}
+
+/**
+ * Score a behaviour at the end of a lifetime, archiving it if novel enough.
+ * 
+ * @param behaviour  the behaviour descriptor
+ * @param goalScore  the score the organism achieved towards the goal
+ * @return           the score
+ */
+double Novelty::evaluate(const float *behaviour, double goalScore) {
+    Heap heap;
+    for(int i = 0; i < m_numRecent; i++)
+        offer(heap, NOVELTY_NEIGHBOURS,
+              distanceSquared(behaviour, &m_recent[i*D]), -1);
+    m_archive.nearest(behaviour, NOVELTY_NEIGHBOURS, heap);
+    double novelty = m_threshold;
+    if(!heap.empty()) {
+        novelty = 0;
+        for(Heap::iterator i = heap.begin(); i != heap.end(); i++)
+            novelty += sqrt(i->first);
+        novelty /= heap.size();
+    }
+    
+    if(novelty > m_threshold) {
+        m_archive.insert(behaviour);
+        m_additions++;
+    }
+    if(++m_evaluations >= NOVELTY_WINDOW) {
+        if(m_additions > NOVELTY_WINDOW / 32) m_threshold *= 1.2;
+        else if(m_additions == 0) m_threshold *= 0.95;
+        m_evaluations = m_additions = 0;
+    }
+    std::copy(behaviour, behaviour + D, &m_recent[m_nextRecent*D]);
+    m_nextRecent = (m_nextRecent + 1) % NEAT::pop_size;
+    if(m_numRecent < NEAT::pop_size) m_numRecent++;
+    
+    if(m_meanNovelty == 0) {
+        m_meanNovelty = novelty;
+        m_meanGoalScore = goalScore;
+    }
+    m_meanNovelty = 0.99 * m_meanNovelty + 0.01 * novelty;
+    m_meanGoalScore = 0.99 * m_meanGoalScore + 0.01 * goalScore;
+    if(m_weight >= 1.0) return novelty;
+    return (1.0 - m_weight) * goalScore / (m_meanGoalScore + 1e-12)
+         + m_weight * novelty / (m_meanNovelty + 1e-12);
+}
+
+/**
+ * Return the number of behaviours in the archive.
+ * 
+ * @return  the size of the archive
+ */
+int Novelty::archiveSize() {
+    return m_archive.size();
+}
+
+/**
+ * Return the novelty above which behaviours are archived.
+ * 
+ * @return  the threshold
+ */
+double Novelty::getThreshold() {
+    return m_threshold;
+}
@@ -0,0 +1,111 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#ifndef NOVELTY_H
+#define NOVELTY_H
+
+#include <vector>
+
+#define NOVELTY_SAMPLES 4 /* positions sampled per lifetime, the last final */
+#define NOVELTY_DIMENSIONS (2 * NOVELTY_SAMPLES)
+#define NOVELTY_NEIGHBOURS 15
+#define NOVELTY_THRESHOLD 20.0 /* initial threshold for archiving, metres */
+#define NOVELTY_WINDOW 256 /* evaluations between threshold adjustments */
+#define KDTREE_BALANCE 0.7 /* largest share of a subtree on either side */
+
+/**
+ * A k-d tree over behaviour descriptors, supporting insertion and k-nearest
+ * neighbour queries. Points are inserted at the leaves as they arrive. When
+ * an insertion lands deeper than a balanced tree of KDTREE_BALANCE would
+ * reach, the lowest ancestor with more than that share of its subtree on one
+ * side is rebuilt balanced, as in a scapegoat tree. Depth thus stays
+ * O(log n) even for the monotone sequences novelty search produces, and
+ * insertions cost amortised O(log n).
+ */
+class KdTree {
+public:
+    KdTree();
+    void insert(const float *point);
+    int size();
+    void nearest(const float *point, int k,
+                 std::vector<std::pair<float, int> > &heap);
+    
+protected:
+    struct Node {
+        int left, right;
+        /** Number of points in the subtree */
+        int size;
+    };
+    /** Coordinates of the points, NOVELTY_DIMENSIONS per point */
+    std::vector<float> m_points;
+    /** Children of each point's node, or -1 */
+    std::vector<Node> m_nodes;
+    /** Axis each point's node splits on */
+    std::vector<unsigned char> m_axes;
+    /** Index of the root, or -1 */
+    int m_root;
+    /** Nodes from the root to the latest insertion */
+    std::vector<int> m_path;
+    /** Scratch space for rebuilding and searching */
+    std::vector<int> m_indices;
+    std::vector<std::pair<float, int> > m_stack;
+    
+    void rebuild(int node, int parent, int depth);
+    int build(int *first, int *last, int depth);
+};
+
+/**
+ * Scores behaviours by their novelty: the mean distance to the k nearest of
+ * the behaviours of the organisms evaluated most recently (standing in for
+ * the current population) and of an archive of past novel behaviours.
+ * 
+ * A behaviour is the position of the body at NOVELTY_SAMPLES evenly spaced
+ * times through its lifetime. Behaviours more novel than a threshold are
+ * added to the archive, and the threshold adapts to keep additions steady.
+ * With a weight below one, novelty is blended with the goal score, each
+ * normalised by its running mean.
+ */
+class Novelty {
+public:
+    Novelty(double weight);
+    double evaluate(const float *behaviour, double goalScore);
+    int archiveSize();
+    double getThreshold();
+    
+protected:
+    /** Weight of novelty against the goal score */
+    double m_weight;
+    /** Archive of novel behaviours */
+    KdTree m_archive;
+    /** Ring of the most recent behaviours */
+    std::vector<float> m_recent;
+    /** Number of behaviours in the ring, and next slot to overwrite */
+    int m_numRecent, m_nextRecent;
+    /** Novelty above which behaviours are archived */
+    double m_threshold;
+    /** Evaluations and archivals since the threshold was adjusted */
+    int m_evaluations, m_additions;
+    /** Running means, for blending */
+    double m_meanNovelty, m_meanGoalScore;
+};
+
+#endif
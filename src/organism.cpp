@@ -22,6 +22,7 @@
 
 #include "organism.h"
 #include "level.h"
+#include "population.h"
 
 #include <cstdlib>
 #include <cstring>
@@ -29,20 +30,49 @@
 
 #include <NEAT/network.h>
 
+TerminationPolicy Organism::termination;
+SensorPolicy Organism::sensing;
+Novelty *Organism::novelty = NULL;
+int Organism::controlPeriod = CONTROL_PERIOD;
+
+SensorPolicy::SensorPolicy()
+    : incremental(false), errorBound(0.0),
+      refreshPeriod(SENSOR_REFRESH_PERIOD) {}
+
+TerminationPolicy::TerminationPolicy()
+    : enabled(false), minAge(TERMINATION_MIN_AGE),
+      stallSpeed(TERMINATION_STALL_SPEED), stallTicks(TERMINATION_STALL_TICKS),
+      driftDistance(TERMINATION_DRIFT_DISTANCE),
+      driftTicks(TERMINATION_DRIFT_TICKS),
+      trendTicks(TERMINATION_TREND_TICKS) {}
+
 /**
- * Create a new organism from the given rtNEAT organism, in the given level.
- * 
- * @param organism  the rtNEAT organism
- * @param level     the level
+ * Create an organism, which must be given an rtNEAT organism and a level with
+ * init() before it is used. Organisms are default-constructible so that a
+ * population can keep them in one contiguous array.
  */
-Organism::Organism(NEAT::Organism *organism, Level *level)
-    : m_organism(organism), m_body(NULL), m_level(level) {
-    inputs = new double[ORGANISM_NUM_INPUTS];
+Organism::Organism()
+    : m_organism(NULL), m_fitness(0), m_timeAlive(0), m_evaluated(false),
+      m_body(NULL),
+      m_level(NULL), m_slot(0), m_force(0.0, 0.0) {
     inputs[ORGANISM_NUM_INPUTS-1] = 1.0; // bias
 }
 
 Organism::~Organism() {
-    m_level->destroyBody(m_body);
+    if(m_body) m_level->destroyBody(m_body);
+}
+
+/**
+ * Set the rtNEAT organism and level of a new organism.
+ * 
+ * @param organism  the rtNEAT organism
+ * @param level     the level
+ * @param slot      the slot of the organism in its population
+ */
+void Organism::init(NEAT::Organism *organism, Level *level, int slot) {
+    setNEATOrganism(organism);
+    m_level = level;
+    m_slot = slot;
 }
 
 /**
@@ -56,20 +86,29 @@ void Organism::step(bool respawn) {
     NEAT::Network *net = m_organism->net;
     b2Vec2 s = m_level->displacementFromGoal(position());
     b2Vec2 v = velocity();
+    if(termination.enabled && !m_level->isolated) {
+        m_level->counters.totalTicks++;
+        if(hopeless(s, v)) {
+            terminate(s, v);
+            return;
+        }
+    }
     score = 1.0 / s.LengthSquared();
+    int controlPeriod = m_level->getControlPeriod();
+    if(controlPeriod > 1
+       && (m_level->getTime() + m_slot) % controlPeriod != 0) {
+        m_body->ApplyForce(m_force, position()); // hold the last action
+        return;
+    }
     inputs[0] = s.x;
     inputs[1] = s.y;
     inputs[2] = v.x;
     inputs[3] = v.y;
     // inputs[4] = slope (set by Level)
-    inputs[5] = raycast(0.00 * b2_pi);
-    inputs[6] = raycast(0.25 * b2_pi);
-    inputs[7] = raycast(0.50 * b2_pi);
-    inputs[8] = raycast(0.75 * b2_pi);
-    inputs[9] = raycast(1.00 * b2_pi);
-    inputs[10] = raycast(1.25 * b2_pi);
-    inputs[11] = raycast(1.50 * b2_pi);
-    inputs[12] = raycast(1.75 * b2_pi);
+    GroundClearance clearance; // measured by the first full query, if any
+    for(int i = 0; i < ORGANISM_NUM_RAYS; i++)
+        inputs[5+i] = raycast(i, i * 2.0 * b2_pi / ORGANISM_NUM_RAYS,
+                              clearance);
     net->load_sensors(inputs);
     memset(inputs, 0, sizeof(double) * ORGANISM_NUM_INPUTS);
     net->activate();
@@ -83,27 +122,51 @@ void Organism::step(bool respawn) {
 void Organism::spawn() {
     if(m_body) m_level->destroyBody(m_body);
     score = 0;
+    m_stallTicks = m_driftTicks = m_ticksSinceImprovement = 0;
+    m_bestScore = 0;
+    m_force.SetZero();
+    for(int i = 0; i < ORGANISM_NUM_RAYS; i++)
+        m_rays[i].valid = false;
     construct(m_level->spawnPoint
-        + 3.0 * b2Vec2((double)rand()/RAND_MAX - 0.5,
-                       (double)rand()/RAND_MAX - 0.5));
+        + 3.0 * b2Vec2(m_level->random() - 0.5, m_level->random() - 0.5));
+}
+
+/**
+ * Keep the organism's body asleep while it is not being stepped, so that it
+ * costs the physics nothing.
+ */
+void Organism::suspend() {
+    if(!m_body->IsSleeping()) m_body->PutToSleep();
 }
 
 /**
- * Return the world position of the organism's body's center of mass.
+ * Empty the organism's slot while its rtNEAT organism, which has been
+ * deleted, awaits a replacement: the body leaves the world, and nothing can
+ * reach the old rtNEAT organism. setNEATOrganism() and spawn() refill it.
+ */
+void Organism::park() {
+    if(m_body) m_level->destroyBody(m_body);
+    m_body = NULL;
+    m_organism = NULL;
+}
+
+/**
+ * Return the world position of the organism's body's center of mass, or the
+ * spawn point while parked.
  * 
  * @return  the position
  */
 b2Vec2 Organism::position() {
-    return m_body->GetWorldCenter();
+    return m_body ? m_body->GetWorldCenter() : m_level->spawnPoint;
 }
 
 /**
- * Return the linear velocity of the organism's body.
+ * Return the linear velocity of the organism's body, or zero while parked.
  * 
  * @return  the velocity
  */
 b2Vec2 Organism::velocity() {
-    return m_body->GetLinearVelocity();
+    return m_body ? m_body->GetLinearVelocity() : b2Vec2(0.0, 0.0);
 }
 
 /**
@@ -122,6 +185,47 @@ NEAT::Organism *Organism::getNEATOrganism() {
  */
 void Organism::setNEATOrganism(NEAT::Organism *organism) {
     m_organism = organism;
+    m_fitness = organism->fitness;
+    m_timeAlive = organism->time_alive;
+    m_evaluated = false;
+}
+
+/**
+ * Return the current fitness, which may not have been committed yet.
+ * 
+ * @return  the fitness
+ */
+double Organism::getFitness() {
+    return m_fitness;
+}
+
+/**
+ * Return the current age, which may not have been committed yet.
+ * 
+ * @return  the number of ticks lived
+ */
+int Organism::getTimeAlive() {
+    return m_timeAlive;
+}
+
+/**
+ * Return whether the organism has been evaluated since the last call, and
+ * forget that it was.
+ * 
+ * @return  true if a run has finished since the last call
+ */
+bool Organism::takeEvaluated() {
+    bool evaluated = m_evaluated;
+    m_evaluated = false;
+    return evaluated;
+}
+
+/**
+ * Copy the current fitness and age to the rtNEAT organism.
+ */
+void Organism::commit() {
+    m_organism->fitness = m_fitness;
+    m_organism->time_alive = m_timeAlive;
 }
 
 /**
@@ -139,29 +243,121 @@ b2Body *Organism::getBody() {
  * @param respawn  suppresses respawning if false
  */
 void Organism::age(bool respawn) {
-    m_organism->time_alive++;
-    if(m_organism->time_alive % NEAT::time_alive_minimum == 0) {
-        m_organism->fitness = (m_organism->fitness + score)/2;
+    m_timeAlive++;
+    if(novelty && !m_level->isolated) sampleBehaviour();
+    if(m_timeAlive % NEAT::time_alive_minimum == 0) {
+        evaluate(score);
         spawn();
     }
 }
 
+/**
+ * Average the score of the run just finished into the organism's fitness.
+ * 
+ * @param goalScore  the score achieved towards the goal
+ */
+void Organism::evaluate(double goalScore) {
+    if(novelty && !m_level->isolated)
+        goalScore = novelty->evaluate(m_behaviour, goalScore);
+    m_fitness = (m_fitness + goalScore)/2;
+    m_evaluated = true;
+    m_level->getPopulation()->markDirty(m_slot); // also covers terminate()
+}
+
+/**
+ * Record the position of the body if this tick is one of the sample points
+ * of the behaviour descriptor.
+ */
+void Organism::sampleBehaviour() {
+    int lifetime = NEAT::time_alive_minimum;
+    int period = lifetime / NOVELTY_SAMPLES;
+    int t = (m_timeAlive - 1) % lifetime + 1;
+    int i;
+    if(t == lifetime) i = NOVELTY_SAMPLES - 1; // always end on the final one
+    else if(period > 0 && t % period == 0 && t / period < NOVELTY_SAMPLES)
+        i = t / period - 1;
+    else return;
+    b2Vec2 p = position();
+    m_behaviour[2*i] = p.x;
+    m_behaviour[2*i+1] = p.y;
+}
+
 /**
  * Perform a physical action with the given output signals.
  * 
  * @param outputs  the array of output signals
  */
-void Organism::act(std::vector<NEAT::NNode*> outputs) {
+void Organism::act(const std::vector<NEAT::NNode*> &outputs) {
     double forceX = 100.0 * (outputs[0]->activation - 0.5);
     double forceY = 0.0;
-    m_body->ApplyForce(b2Vec2(forceX, forceY), position());
+    m_force.Set(forceX, forceY);
+    m_body->ApplyForce(m_force, position());
 }
 
 /**
  * Kill the organism, penalise it, and respawn it.
  */
 void Organism::kill() {
-    m_organism->fitness /= 2;
+    m_fitness /= 2;
+    m_level->getPopulation()->markDirty(m_slot);
+    spawn();
+}
+
+/**
+ * Decide whether the current evaluation is hopeless, given the displacement
+ * from the goal and velocity of the body.
+ * 
+ * @param s  the displacement from the goal
+ * @param v  the velocity
+ * @return   true if the evaluation should be terminated
+ */
+bool Organism::hopeless(b2Vec2 s, b2Vec2 v) {
+    double distance = s.Length();
+    double current = 1.0 / (distance * distance);
+    if(current > m_bestScore) {
+        m_bestScore = current;
+        m_ticksSinceImprovement = 0;
+    } else {
+        m_ticksSinceImprovement++;
+    }
+    m_stallTicks = (v.Length() < termination.stallSpeed) ? m_stallTicks + 1 : 0;
+    bool receding = b2Dot(s, v) > 0;
+    m_driftTicks = (receding && distance > termination.driftDistance) ?
+        m_driftTicks + 1 : 0;
+    if(m_timeAlive % NEAT::time_alive_minimum < termination.minAge)
+        return false;
+    return m_stallTicks >= termination.stallTicks
+        || m_driftTicks >= termination.driftTicks
+        || (m_ticksSinceImprovement >= termination.trendTicks && receding);
+}
+
+/**
+ * Terminate the current evaluation early, scoring it as if the body kept
+ * moving away from the goal at its current rate until the end of its
+ * lifetime, and respawn.
+ * 
+ * @param s  the displacement from the goal
+ * @param v  the velocity
+ */
+void Organism::terminate(b2Vec2 s, b2Vec2 v) {
+    int remaining = NEAT::time_alive_minimum
+                  - m_timeAlive % NEAT::time_alive_minimum;
+    double distance = s.Length();
+    double receding = b2Dot(s, v) / distance;
+    if(receding > 0) distance += receding * remaining / FRAME_RATE;
+    if(novelty) { // the body is taken to stay where it is
+        int period = NEAT::time_alive_minimum / NOVELTY_SAMPLES;
+        int t = m_timeAlive % NEAT::time_alive_minimum;
+        b2Vec2 p = position();
+        for(int i = period > 0 ? t / period : 0; i < NOVELTY_SAMPLES; i++) {
+            m_behaviour[2*i] = p.x;
+            m_behaviour[2*i+1] = p.y;
+        }
+    }
+    m_timeAlive += remaining;
+    evaluate(1.0 / (distance * distance));
+    m_level->counters.terminations++;
+    m_level->counters.savedTicks += remaining;
     spawn();
 }
 
@@ -174,6 +370,7 @@ void Organism::construct(b2Vec2 position) {
     b2BodyDef bodyDef;
     bodyDef.position = position;
     bodyDef.angularDamping = 1.0;
+    bodyDef.userData = this; // for Population::find
     m_body = m_level->createBody(&bodyDef);
     
     b2CircleDef circleDef;
@@ -187,14 +384,42 @@ void Organism::construct(b2Vec2 position) {
 /**
  * Perform a raycast from this organism in the given direction.
  * 
- * @param angle  the direction in radians
- * @param range  the length of the ray
- * @return       the distance to the intersection
+ * @param ray        the index of the ray, for incremental sensing
+ * @param angle      the direction in radians
+ * @param clearance  the distances from this tick's position to the ground,
+ *                   measured here if not yet measured
+ * @param range      the length of the ray
+ * @return           the distance to the intersection
  */
-double Organism::raycast(double angle, double range) {
+double Organism::raycast(int ray, double angle, GroundClearance &clearance,
+                         double range) {
     b2Vec2 direction(cos(angle), sin(angle));
     b2Segment segment;
     segment.p1 = position();
     segment.p2 = position() + range * direction;
-    return m_level->raycast(segment);
+    if(!sensing.incremental) return m_level->raycast(segment);
+    
+    RayCache &cache = m_rays[ray];
+    // rays are only cast every controlPeriod ticks, so refresh at the first
+    // of those to fall on or after each due tick
+    int refreshPeriod = m_level->getRefreshPeriod();
+    bool due = sensing.errorBound > 0 && refreshPeriod > 0
+        && (m_timeAlive + ray) % refreshPeriod < m_level->getControlPeriod();
+    if(cache.valid && !due) {
+        double lambda = cache.shape ?
+            m_level->raycastShape(segment, cache.shape) : 1.0;
+        double bound = cache.clearance - (segment.p1 - cache.origin).Length()
+                     + sensing.errorBound;
+        if(lambda * range <= bound) {
+            if(!m_level->isolated) m_level->counters.cachedQueries++;
+            return lambda;
+        }
+    }
+    if(!m_level->isolated) m_level->counters.fullQueries++;
+    double lambda = m_level->raycast(segment, &cache.shape);
+    cache.valid = true;
+    cache.origin = segment.p1;
+    if(clearance.nearest < 0) m_level->groundClearance(segment.p1, clearance);
+    cache.clearance = clearance.excluding(cache.shape);
+    return lambda;
 }
@@ -23,44 +23,163 @@
 #ifndef ORGANISM_H
 #define ORGANISM_H
 
+#include "novelty.h"
+
 #include <Box2D.h>
 #include <NEAT/organism.h>
 
 #define ORGANISM_NUM_INPUTS 14 /* number of inputs, including bias */
 #define ORGANISM_NUM_OUTPUTS 1
+#define ORGANISM_NUM_RAYS 8
+#define SENSOR_REFRESH_PERIOD 30 /* ticks between forced full raycasts */
+#define CONTROL_PERIOD 1 /* ticks between network activations */
+
+/* defaults for early termination, in ticks and metres */
+#define TERMINATION_MIN_AGE 120
+#define TERMINATION_STALL_SPEED 0.5
+#define TERMINATION_STALL_TICKS 120
+#define TERMINATION_DRIFT_DISTANCE 100.0
+#define TERMINATION_DRIFT_TICKS 180
+#define TERMINATION_TREND_TICKS 600
 
+struct GroundClearance;
 class Level;
 
+/**
+ * Policy for incremental sensing. Each ray remembers the shape it hit and the
+ * clearance from its origin to every other shape of the ground. While the
+ * ray, tested against the remembered shape alone, ends closer than that
+ * clearance (less the distance moved since), no other shape can be closer, so
+ * the full query against all of the ground can be skipped.
+ * 
+ * With a positive error bound the test is relaxed by that many metres, and
+ * each ray is instead fully refreshed every refreshPeriod ticks, staggered
+ * across rays; a reported distance then overestimates the true one by at
+ * most errorBound.
+ */
+struct SensorPolicy {
+    /** Should sensing be incremental? */
+    bool incremental;
+    /** Maximum overestimate of a ray's length, in metres */
+    double errorBound;
+    /**
+     * Ticks between forced full queries when errorBound is positive, that
+     * new levels start with (see Level)
+     */
+    int refreshPeriod;
+    
+    SensorPolicy();
+};
+
+/**
+ * Policy for ending an evaluation before the end of the organism's lifetime,
+ * once the body has stopped moving, is drifting away from a distant goal, or
+ * has stopped improving its score. The evaluation is scored with the score
+ * the organism would get if it kept its current radial velocity for the rest
+ * of its lifetime.
+ */
+struct TerminationPolicy {
+    /** Should evaluations be terminated early? */
+    bool enabled;
+    /** Ticks into a lifetime before any termination */
+    int minAge;
+    /** Speed below which the body is considered stalled */
+    double stallSpeed;
+    /** Ticks stalled before terminating */
+    int stallTicks;
+    /** Distance from the goal beyond which drifting away is hopeless */
+    double driftDistance;
+    /** Ticks drifting away before terminating */
+    int driftTicks;
+    /** Ticks without improving the best score before terminating */
+    int trendTicks;
+    
+    TerminationPolicy();
+};
+
 class Organism {
 public:
     /** Inputs to the organism's sensors */
-    double *inputs;
+    double inputs[ORGANISM_NUM_INPUTS];
     /** Score of the organism for this run */
     double score;
+    /** Early termination policy shared by all organisms */
+    static TerminationPolicy termination;
+    /** Sensing policy shared by all organisms */
+    static SensorPolicy sensing;
+    /** Novelty scorer shared by all organisms, or NULL to score by goal */
+    static Novelty *novelty;
+    /** Control period that new levels start with (see Level) */
+    static int controlPeriod;
     
-    Organism(NEAT::Organism *organism, Level *level);
+    Organism();
     ~Organism();
+    void init(NEAT::Organism *organism, Level *level, int slot = 0);
     void step(bool respawn);
     void spawn();
+    void suspend();
+    void park();
     b2Vec2 position();
     b2Vec2 velocity();
     NEAT::Organism *getNEATOrganism();
     void setNEATOrganism(NEAT::Organism *organism);
+    double getFitness();
+    int getTimeAlive();
+    bool takeEvaluated();
+    void commit();
     b2Body *getBody();
     
 protected:
     /** The rtNEAT organism */
     NEAT::Organism *m_organism;
+    /**
+     * Fitness and age, kept here and only copied to the rtNEAT organism by
+     * commit(), so that it can be read while the organism goes on living
+     */
+    double m_fitness;
+    int m_timeAlive;
+    /** Has the organism been evaluated since takeEvaluated() last said so? */
+    bool m_evaluated;
     /** The organism's physical body */
     b2Body *m_body;
     /** The level the organism lives in */
     Level *m_level;
+    /** Slot of the organism in its population, for staggering control */
+    int m_slot;
+    /** Force applied by the last activation of the network */
+    b2Vec2 m_force;
+    /** Consecutive ticks spent stalled */
+    int m_stallTicks;
+    /** Consecutive ticks spent drifting away from the goal */
+    int m_driftTicks;
+    /** Best score this run */
+    double m_bestScore;
+    /** Ticks since the best score improved */
+    int m_ticksSinceImprovement;
+    /** Behaviour descriptor of the current run, for novelty search */
+    float m_behaviour[NOVELTY_DIMENSIONS];
+    /** What each ray saw at its last full query */
+    struct RayCache {
+        /** Is the rest of the cache valid? */
+        bool valid;
+        /** The shape hit, or NULL */
+        b2Shape *shape;
+        /** Where the ray started */
+        b2Vec2 origin;
+        /** Distance from the origin to every other shape */
+        double clearance;
+    } m_rays[ORGANISM_NUM_RAYS];
     
     void age(bool respawn);
-    void act(std::vector<NEAT::NNode*> outputs);
+    void evaluate(double goalScore);
+    void sampleBehaviour();
+    void act(const std::vector<NEAT::NNode*> &outputs);
     void kill();
+    bool hopeless(b2Vec2 s, b2Vec2 v);
+    void terminate(b2Vec2 s, b2Vec2 v);
     void construct(b2Vec2 position);
-    double raycast(double angle, double range = 50.0);
+    double raycast(int ray, double angle, GroundClearance &clearance,
+                   double range = 50.0);
 };
 
 #endif
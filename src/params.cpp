@@ -0,0 +1,159 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#include "params.h"
+#include "organism.h"
+#include "population.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <NEAT/neat.h>
+
+/** A tunable parameter, named as in params.ne where applicable */
+struct Param {
+    const char *name;
+    char type; /* 'd'ouble, 'i'nt or 'b'ool */
+    void *value;
+};
+
+static Param params[] = {
+    { "trait_param_mut_prob", 'd', &NEAT::trait_param_mut_prob },
+    { "trait_mutation_power", 'd', &NEAT::trait_mutation_power },
+    { "linktrait_mut_sig", 'd', &NEAT::linktrait_mut_sig },
+    { "nodetrait_mut_sig", 'd', &NEAT::nodetrait_mut_sig },
+    { "weigh_mut_power", 'd', &NEAT::weight_mut_power },
+    { "recur_prob", 'd', &NEAT::recur_prob },
+    { "disjoint_coeff", 'd', &NEAT::disjoint_coeff },
+    { "excess_coeff", 'd', &NEAT::excess_coeff },
+    { "mutdiff_coeff", 'd', &NEAT::mutdiff_coeff },
+    { "compat_thresh", 'd', &NEAT::compat_threshold },
+    { "age_significance", 'd', &NEAT::age_significance },
+    { "survival_thresh", 'd', &NEAT::survival_thresh },
+    { "mutate_only_prob", 'd', &NEAT::mutate_only_prob },
+    { "mutate_random_trait_prob", 'd', &NEAT::mutate_random_trait_prob },
+    { "mutate_link_trait_prob", 'd', &NEAT::mutate_link_trait_prob },
+    { "mutate_node_trait_prob", 'd', &NEAT::mutate_node_trait_prob },
+    { "mutate_link_weights_prob", 'd', &NEAT::mutate_link_weights_prob },
+    { "mutate_toggle_enable_prob", 'd', &NEAT::mutate_toggle_enable_prob },
+    { "mutate_gene_reenable_prob", 'd', &NEAT::mutate_gene_reenable_prob },
+    { "mutate_add_node_prob", 'd', &NEAT::mutate_add_node_prob },
+    { "mutate_add_link_prob", 'd', &NEAT::mutate_add_link_prob },
+    { "interspecies_mate_rate", 'd', &NEAT::interspecies_mate_rate },
+    { "mate_multipoint_prob", 'd', &NEAT::mate_multipoint_prob },
+    { "mate_multipoint_avg_prob", 'd', &NEAT::mate_multipoint_avg_prob },
+    { "mate_singlepoint_prob", 'd', &NEAT::mate_singlepoint_prob },
+    { "mate_only_prob", 'd', &NEAT::mate_only_prob },
+    { "recur_only_prob", 'd', &NEAT::recur_only_prob },
+    { "pop_size", 'i', &NEAT::pop_size },
+    { "dropoff_age", 'i', &NEAT::dropoff_age },
+    { "newlink_tries", 'i', &NEAT::newlink_tries },
+    { "babies_stolen", 'i', &NEAT::babies_stolen },
+    
+    { "INELIGIBLE_PROPORTION", 'd', &Population::ineligibleProportion },
+    { "NUM_SPECIES_TARGET", 'i', &Population::numSpeciesTarget },
+    { "COMPATIBILITY_THRESHOLD_DELTA", 'd',
+      &Population::compatibilityThresholdDelta },
+    { "ASYNC_EVOLUTION", 'b', &Population::asyncEvolution },
+    { "SCREEN_BATCH", 'i', &Population::screenBatch },
+    { "SCREEN_THRESHOLD", 'd', &Population::screenThreshold },
+    { "CHECK_INDEX", 'b', &Population::checkIndex },
+    
+    { "early_termination", 'b', &Organism::termination.enabled },
+    { "termination_stall_ticks", 'i', &Organism::termination.stallTicks },
+    { "termination_drift_ticks", 'i', &Organism::termination.driftTicks },
+    { "termination_trend_ticks", 'i', &Organism::termination.trendTicks },
+    { "incremental_sensing", 'b', &Organism::sensing.incremental },
+    { "sensor_error_bound", 'd', &Organism::sensing.errorBound },
+    { "control_period", 'i', &Organism::controlPeriod },
+    { NULL, 0, NULL }
+};
+
+static Param *findParam(const char *name) {
+    for(Param *p = params; p->name; p++)
+        if(strcmp(p->name, name) == 0) return p;
+    return NULL;
+}
+
+/**
+ * Set a parameter by name. Besides the rtNEAT parameters of params.ne, the
+ * population's macros and the organisms' policies can be set.
+ * 
+ * @param name   the name of the parameter
+ * @param value  the new value
+ * @return       false if there is no such parameter
+ */
+bool setParam(const char *name, double value) {
+    Param *p = findParam(name);
+    if(!p) return false;
+    switch(p->type) {
+    case 'd': *(double *) p->value = value; break;
+    case 'i': *(int *) p->value = (int) value; break;
+    case 'b': *(bool *) p->value = value != 0; break;
+    }
+    return true;
+}
+
+/**
+ * Get the value of a parameter by name.
+ * 
+ * @param name   the name of the parameter
+ * @param value  set to the value
+ * @return       false if there is no such parameter
+ */
+bool getParam(const char *name, double *value) {
+    Param *p = findParam(name);
+    if(!p) return false;
+    switch(p->type) {
+    case 'd': *value = *(double *) p->value; break;
+    case 'i': *value = *(int *) p->value; break;
+    case 'b': *value = *(bool *) p->value; break;
+    }
+    return true;
+}
+
+/**
+ * Apply a comma-separated list of name=value assignments.
+ * 
+ * @param assignments  the assignments, e.g. "pop_size=64,recur_prob=0.1"
+ * @return             false if any assignment was malformed or unknown
+ */
+bool applyParams(const char *assignments) {
+    std::string list(assignments);
+    size_t start = 0;
+    while(start < list.size()) {
+        size_t end = list.find(',', start);
+        if(end == std::string::npos) end = list.size();
+        std::string item = list.substr(start, end - start);
+        size_t eq = item.find('=');
+        if(eq == std::string::npos
+           || !setParam(item.substr(0, eq).c_str(),
+                        atof(item.c_str() + eq + 1))) {
+            fprintf(stderr, "bad parameter assignment: %s\n", item.c_str());
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
@@ -21,37 +21,81 @@
 */
 
 #include "population.h"
+#include "arena.h"
+#include "archive.h"
+#include "governor.h"
 #include "level.h"
+#include "lineage.h"
 #include "organism.h"
+#include "sandbox.h"
+#include "stats.h"
+#include "trace.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <fstream>
 #include <vector>
 #include <cstdio>
+#include <cstdlib>
 
 #include <NEAT/species.h>
 
 #define INELIGIBLE_PROPORTION 0.5
 #define NUM_SPECIES_TARGET 4
 #define COMPATIBILITY_THRESHOLD_DELTA 0.1
+#define ASYNC_EVOLUTION false
+#define SCREEN_BATCH 0 /* candidates per sandbox batch, 0 to disable */
+#define SCREEN_THRESHOLD 0.5
+#define SCREEN_MAX_BATCHES 4
+#define CHECK_INDEX false
+
+double Population::ineligibleProportion = INELIGIBLE_PROPORTION;
+int Population::numSpeciesTarget = NUM_SPECIES_TARGET;
+double Population::compatibilityThresholdDelta = COMPATIBILITY_THRESHOLD_DELTA;
+bool Population::asyncEvolution = ASYNC_EVOLUTION;
+int Population::screenBatch = SCREEN_BATCH;
+double Population::screenThreshold = SCREEN_THRESHOLD;
+bool Population::checkIndex = CHECK_INDEX;
 
 /**
  * Create a new population.
  * 
  * @param world              the world the population lives in
  * @param lifetime           the lifetime of the organisms in this population
+ * @param size               the number of organisms, or 0 for NEAT::pop_size
  */
-Population::Population(Level *level, int lifetime)
-    : evolve(false), m_numOffspring(0), m_ticksSinceEvolution(0),
-      m_level(level) {
-    generatePopulation(new NEAT::Genome(
-        ORGANISM_NUM_INPUTS, ORGANISM_NUM_OUTPUTS, 0, 0));
+Population::Population(Level *level, int lifetime, int size)
+    : evolve(false), stats(NULL), archive(NULL), trace(NULL), sandbox(NULL),
+      governor(NULL), m_size(size > 0 ? size : NEAT::pop_size),
+      m_active(m_size), m_numOffspring(0),
+      m_numScreened(0), m_numRejected(0), m_numAdmitted(0),
+      m_totalAdmittedScore(0),
+      m_ticksSinceEvolution(0), m_level(level), m_lineage(NULL),
+      m_evolutionStarted(false),
+      m_job(JOB_IDLE), m_parkedSlot(-1), m_offspring(NULL) {
+    pthread_mutex_init(&m_evolutionLock, NULL);
+    pthread_cond_init(&m_evolutionChanged, NULL);
+    NEAT::Genome *starterGenome =
+        new NEAT::Genome(ORGANISM_NUM_INPUTS, ORGANISM_NUM_OUTPUTS, 0, 0);
+    generatePopulation(starterGenome);
+    delete starterGenome; // the population spawns from duplicates
     setLifetime(lifetime);
 }
 
 Population::~Population() {
-    for(int i = 0; i < NEAT::pop_size; i++)
-        delete m_organisms[i];
+    if(m_evolutionStarted) {
+        pthread_mutex_lock(&m_evolutionLock);
+        while(m_job == JOB_REQUESTED)
+            pthread_cond_wait(&m_evolutionChanged, &m_evolutionLock);
+        m_job = JOB_STOP;
+        pthread_cond_broadcast(&m_evolutionChanged);
+        pthread_mutex_unlock(&m_evolutionLock);
+        pthread_join(m_evolutionThread, NULL);
+    }
+    pthread_mutex_destroy(&m_evolutionLock);
+    pthread_cond_destroy(&m_evolutionChanged);
+    delete sandbox;
     delete [] m_organisms;
     delete m_population;
 }
@@ -64,26 +108,41 @@ Population::~Population() {
 void Population::setLifetime(int lifetime) {
     assert(lifetime > 0);
     NEAT::time_alive_minimum = lifetime;
+    m_lifetime = lifetime;
     m_evolutionSpacing =
-        (double) lifetime / (INELIGIBLE_PROPORTION * NEAT::pop_size);
+        (double) lifetime / (ineligibleProportion * m_active);
+    for(int i = 0; i < m_size; i++) // eligibility depends on the lifetime
+        reindex(i);
 }
 
 /**
  * Spawn all organisms.
  */
 void Population::spawn() {
-    for(int i = 0; i < NEAT::pop_size; i++)
-        m_organisms[i]->spawn();
+    for(int i = 0; i < m_size; i++)
+        m_organisms[i].spawn();
 }
 
 /**
  * Step the population forward by one timestep.
  */
 void Population::step() {
-    for(int i = 0; i < NEAT::pop_size; i++)
-        m_organisms[i]->step(evolve);
-    if(evolve && ++m_ticksSinceEvolution >= m_evolutionSpacing)
-        evolvePopulation();
+    StatsTimer timer(stats);
+    double start = governor ? statsClock() : 0;
+    for(int i = 0; i < m_size; i++) {
+        if(i == m_parkedSlot) continue;
+        if(i < m_active) m_organisms[i].step(evolve);
+        else m_organisms[i].suspend();
+    }
+    if(m_parkedSlot < 0) // otherwise the evolution thread is reading them
+        commit();
+    timer.lap(STATS_PHASE_ORGANISMS);
+    if(governor) governor->addOrganismTime(statsClock() - start);
+    if(evolve && ++m_ticksSinceEvolution >= m_evolutionSpacing) {
+        if(asyncEvolution) evolveAsync();
+        else evolvePopulation();
+        timer.lap(STATS_PHASE_EVOLUTION);
+    }
 }
 
 /**
@@ -93,11 +152,177 @@ void Population::step() {
  * @return      the corresponding organism if found, NULL otherwise
  */
 Organism *Population::find(b2Body *body) {
-    for(int i = 0; i < NEAT::pop_size; i++)
-        if(m_organisms[i]->getBody() == body)
-            return m_organisms[i];
+    Organism *organism = (Organism *) body->GetUserData();
+    if(organism >= m_organisms && organism < m_organisms + m_size)
+        return organism;
     return NULL;
-            
+}
+
+/**
+ * Return the highest fitness of any organism in the population.
+ * 
+ * @return  the fitness
+ */
+double Population::bestFitness() {
+    double best = 0;
+    for(int i = 0; i < m_size; i++) { // by slot, safe while busy()
+        if(i == m_parkedSlot) continue;
+        double fitness = m_organisms[i].getNEATOrganism()->fitness;
+        if(fitness > best) best = fitness;
+    }
+    return best;
+}
+
+/**
+ * Return whether the background evolution thread may be using the rtNEAT
+ * population, which must then be left alone.
+ * 
+ * @return  true while reproducing in the background
+ */
+bool Population::busy() {
+    pthread_mutex_lock(&m_evolutionLock);
+    bool requested = m_job == JOB_REQUESTED;
+    pthread_mutex_unlock(&m_evolutionLock);
+    return requested;
+}
+
+/**
+ * Return the i-th organism of the population.
+ * 
+ * @param i  the index of the organism (less than getSize())
+ * @return   the organism
+ */
+Organism *Population::getOrganism(int i) {
+    return &m_organisms[i];
+}
+
+/**
+ * Return the number of organisms in the population.
+ * 
+ * @return  the number of organisms
+ */
+int Population::getSize() {
+    return m_size;
+}
+
+/**
+ * Step only the first few organisms, suspending the others where they are
+ * until they are made active again. Evolution slows down in proportion, so
+ * that organisms still reach maturity before being judged, and suspended
+ * organisms leave the index at the next commit, so that they are neither
+ * removed nor replaced by offspring that would never be stepped.
+ * 
+ * @param active  the number of organisms to step
+ */
+void Population::setActive(int active) {
+    m_active = std::max(1, std::min(active, m_size));
+    m_evolutionSpacing =
+        (double) m_lifetime / (ineligibleProportion * m_active);
+}
+
+/**
+ * Return the number of organisms being stepped.
+ * 
+ * @return  the number of organisms
+ */
+int Population::getActive() {
+    return m_active;
+}
+
+/**
+ * Return the rtNEAT population.
+ * 
+ * @return  the rtNEAT population
+ */
+NEAT::Population *Population::getNEATPopulation() {
+    return m_population;
+}
+
+/**
+ * Return the work done by the organisms so far.
+ * 
+ * @param counters  set to the level's counters
+ */
+void Population::getCounters(EvaluationCounters &counters) {
+    counters = m_level ? m_level->counters : EvaluationCounters();
+}
+
+/**
+ * Return the number of offspring born so far.
+ * 
+ * @return  the number of offspring
+ */
+int Population::getNumOffspring() {
+    return m_numOffspring;
+}
+
+/**
+ * Give the i-th organism a new rtNEAT organism, and respawn it.
+ * 
+ * @param i         the index of the organism
+ * @param organism  the new rtNEAT organism
+ */
+void Population::setNEATOrganism(int i, NEAT::Organism *organism) {
+    bind(i, organism);
+    m_organisms[i].spawn();
+}
+
+/**
+ * Replace the whole rtNEAT population with copies of the given genomes,
+ * repeating them as necessary to fill the population.
+ * 
+ * @param genomes  the genomes (not taken over by the population)
+ */
+void Population::seed(std::vector<NEAT::Genome*> &genomes) {
+    if(genomes.empty()) return;
+    ArenaScope scope;
+    std::vector<NEAT::Genome*> copies;
+    int lastNode = 0;
+    double lastInnovation = 0;
+    for(int i = 0; i < m_size; i++) {
+        NEAT::Genome *genome = genomes[i % genomes.size()]->duplicate(i + 1);
+        for(std::vector<NEAT::NNode*>::iterator j = genome->nodes.begin();
+            j != genome->nodes.end(); j++)
+            if((*j)->node_id > lastNode) lastNode = (*j)->node_id;
+        for(std::vector<NEAT::Gene*>::iterator j = genome->genes.begin();
+            j != genome->genes.end(); j++)
+            if((*j)->innovation_num > lastInnovation)
+                lastInnovation = (*j)->innovation_num;
+        copies.push_back(genome);
+    }
+    NEAT::Population *population = new NEAT::Population(copies, 0.0);
+    // don't rely on the last genome having the newest innovations
+    population->cur_node_id = lastNode + 1;
+    population->cur_innov_num = lastInnovation + 1;
+    for(int i = 0; i < m_size; i++) {
+        NEAT::Organism *oldOrganism = m_organisms[i].getNEATOrganism();
+        if(m_lineage) {
+            m_lineage->death(oldOrganism, m_numOffspring, false);
+            m_lineage->founder(population->organisms[i], m_numOffspring);
+        }
+        replaceOrganism(oldOrganism, population->organisms[i]);
+    }
+    delete m_population;
+    m_population = population;
+}
+
+/**
+ * Record births and deaths to the given lineage log, starting with the
+ * current organisms as founders.
+ * 
+ * @param lineage  the lineage log, or NULL to stop recording
+ */
+void Population::setLineage(Lineage *lineage) {
+    if(m_evolutionStarted) { // let a background birth finish being logged
+        pthread_mutex_lock(&m_evolutionLock);
+        while(m_job == JOB_REQUESTED)
+            pthread_cond_wait(&m_evolutionChanged, &m_evolutionLock);
+        pthread_mutex_unlock(&m_evolutionLock);
+    }
+    m_lineage = lineage;
+    if(!lineage) return;
+    for(int i = 0; i < m_size; i++)
+        lineage->founder(m_organisms[i].getNEATOrganism(), m_numOffspring);
 }
 
 /**
@@ -106,11 +331,20 @@ Organism *Population::find(b2Body *body) {
  * @param starterGenome  the starter genome
  */
 void Population::generatePopulation(NEAT::Genome *starterGenome) {
-    m_population = new NEAT::Population(starterGenome, NEAT::pop_size);
+    {
+        ArenaScope scope;
+        m_population = new NEAT::Population(starterGenome, m_size);
+    }
     assert(m_population->verify());
-    m_organisms = new Organism* [NEAT::pop_size];
-    for(int i = 0; i < NEAT::pop_size; i++)
-        m_organisms[i] = new Organism(m_population->organisms[i], m_level);
+    m_organisms = new Organism[m_size];
+    m_index.resize(m_size);
+    m_indexedActive = m_size;
+    m_dirty.assign(m_size, false);
+    for(int i = 0; i < m_size; i++) {
+        m_organisms[i].init(m_population->organisms[i], m_level, i);
+        m_slots[m_population->organisms[i]] = i;
+        m_index.update(i, m_population->organisms[i]);
+    }
 }
 
 /**
@@ -118,17 +352,239 @@ void Population::generatePopulation(NEAT::Genome *starterGenome) {
  */
 void Population::evolvePopulation() {
     m_ticksSinceEvolution = 0;
-    NEAT::Organism *deadOrganism = m_population->remove_worst();
+    NEAT::Organism *deadOrganism = removeWorst();
     if(!deadOrganism) return; // no mature organisms
+    if(sandbox && m_level) sandbox->setGoal(m_level->getGoal());
+    NEAT::Organism *newOrganism = breed();
+    reassignSpecies();
+    replaceOrganism(deadOrganism, newOrganism);
+}
+
+/**
+ * Archive the champion and remove the worst organism, reporting on the state
+ * of the population.
+ * 
+ * @return  the removed organism, or NULL if none is mature
+ */
+NEAT::Organism *Population::removeWorst() {
+    if(archive) archiveChampion();
+    // the index finds the organism remove_worst() would, without a full scan
+    int slot = m_index.worst();
+    if(checkIndex) checkWorst(slot);
+    if(slot < 0) return NULL;
+    // removing the organism deletes it, along with its genome and network;
+    // the dangling pointer only serves to find the slot to refill
+    NEAT::Organism *deadOrganism = m_organisms[slot].getNEATOrganism();
+    m_index.remove(slot);
+    if(m_lineage) m_lineage->death(deadOrganism, m_numOffspring, false);
+    removeOrganism(deadOrganism);
     printf("%d species\n", m_population->species.size());
     for(std::vector<NEAT::Species*>::iterator
         i = m_population->species.begin(), e = m_population->species.end();
         i != e; i++)
         printf("species #%d:\tsize=%3d,\taverage=%f\n",
             (*i)->id, (*i)->organisms.size(), (*i)->average_est);
-    NEAT::Organism *newOrganism = reproduce();
-    reassignSpecies();
-    replaceOrganism(deadOrganism, newOrganism);
+    if(Organism::termination.enabled) {
+        EvaluationCounters counters;
+        getCounters(counters);
+        printf("early termination: %lld evaluations, %lld ticks saved\n",
+            counters.terminations, counters.savedTicks);
+    }
+    if(Organism::novelty)
+        printf("novelty archive: %d behaviours, threshold %f\n",
+            Organism::novelty->archiveSize(),
+            Organism::novelty->getThreshold());
+    if(sandbox)
+        printf("screening: %lld candidates, %lld rejected, %lld sandbox "
+            "ticks\n", m_numScreened, m_numRejected, sandbox->getTicks());
+    return deadOrganism;
+}
+
+/**
+ * Evolve the population without stalling the simulation: the offspring is
+ * produced on a background thread while the population goes on living, and
+ * takes the removed organism's slot at the following evolution.
+ * 
+ * The background thread sees the fitness and ages committed here, and nothing
+ * else touches the rtNEAT population until it is done, so the offspring, and
+ * hence the whole run, depends only on the seed and not on thread timing.
+ */
+void Population::evolveAsync() {
+    m_ticksSinceEvolution = 0;
+    if(m_parkedSlot >= 0) {
+        pthread_mutex_lock(&m_evolutionLock);
+        while(m_job == JOB_REQUESTED) // almost always finished long ago
+            pthread_cond_wait(&m_evolutionChanged, &m_evolutionLock);
+        m_job = JOB_IDLE;
+        pthread_mutex_unlock(&m_evolutionLock);
+        refill(m_parkedSlot, m_offspring);
+        m_parkedSlot = -1;
+    }
+    commit();
+    
+    NEAT::Organism *deadOrganism = removeWorst();
+    if(!deadOrganism) return; // no mature organisms
+    // the slot stays empty, its body out of the world, until the offspring
+    // is ready; the dead organism's address may be reused by then
+    m_parkedSlot = slotOf(deadOrganism);
+    m_slots.erase(deadOrganism);
+    m_organisms[m_parkedSlot].park();
+    if(sandbox && m_level) sandbox->setGoal(m_level->getGoal());
+    if(!m_evolutionStarted) {
+        if(pthread_create(&m_evolutionThread, NULL, runEvolution, this)) {
+            perror("pthread_create");
+            exit(1);
+        }
+        m_evolutionStarted = true;
+    }
+    pthread_mutex_lock(&m_evolutionLock);
+    m_job = JOB_REQUESTED;
+    pthread_cond_broadcast(&m_evolutionChanged);
+    pthread_mutex_unlock(&m_evolutionLock);
+}
+
+/**
+ * Main loop of the background evolution thread: reproduce and respeciate
+ * whenever asked to.
+ */
+void *Population::runEvolution(void *arg) {
+    Population *population = (Population *) arg;
+    pthread_mutex_lock(&population->m_evolutionLock);
+    while(true) {
+        while(population->m_job == JOB_IDLE || population->m_job == JOB_DONE)
+            pthread_cond_wait(&population->m_evolutionChanged,
+                              &population->m_evolutionLock);
+        if(population->m_job == JOB_STOP) break;
+        pthread_mutex_unlock(&population->m_evolutionLock);
+        NEAT::Organism *offspring = population->breed();
+        population->reassignSpecies();
+        pthread_mutex_lock(&population->m_evolutionLock);
+        population->m_offspring = offspring;
+        population->m_job = JOB_DONE;
+        pthread_cond_broadcast(&population->m_evolutionChanged);
+    }
+    pthread_mutex_unlock(&population->m_evolutionLock);
+    return NULL;
+}
+
+/**
+ * Produce the offspring to be let into the population, screening candidates
+ * in the sandbox first if there is one.
+ * 
+ * @return  the offspring
+ */
+NEAT::Organism *Population::breed() {
+    return sandbox ? screenOffspring() : reproduce();
+}
+
+/**
+ * Reproduce batches of candidates and score them in the sandbox, until the
+ * best so far scores at least screenThreshold times the mean score of the
+ * candidates admitted before, or SCREEN_MAX_BATCHES have been tried. The
+ * best candidate is admitted regardless, since the slot must be filled; the
+ * rest are removed from the population at once, before they cost a lifetime
+ * in the live world. Candidates are withheld from their species until then,
+ * so that none is chosen as a parent, or inferred to be one, unscreened.
+ * 
+ * @return  the best candidate
+ */
+NEAT::Organism *Population::screenOffspring() {
+    NEAT::Organism *best = NULL;
+    double bestScore = 0;
+    std::vector<NEAT::Organism*> candidates;
+    std::vector<double> scores;
+    // measured against earlier admissions, since the best of a batch always
+    // beats the batch's own mean
+    double bar = m_numAdmitted > 0 ?
+        screenThreshold * m_totalAdmittedScore / m_numAdmitted : 0;
+    for(int batch = 0; batch < SCREEN_MAX_BATCHES; batch++) {
+        candidates.clear();
+        for(int i = 0; i < sandbox->getBatchSize(); i++) {
+            candidates.push_back(reproduce());
+            withhold(candidates.back());
+        }
+        sandbox->evaluate(candidates, scores);
+        for(size_t i = 0; i < candidates.size(); i++) {
+            m_numScreened++;
+            if(!best || scores[i] > bestScore) {
+                if(best) discard(best);
+                best = candidates[i];
+                bestScore = scores[i];
+            } else {
+                discard(candidates[i]);
+            }
+        }
+        if(bestScore >= bar) break;
+    }
+    restore(best);
+    m_numAdmitted++;
+    m_totalAdmittedScore += bestScore;
+    return best;
+}
+
+/**
+ * Remove a rejected candidate, which has been withheld, from the population,
+ * and delete it.
+ * 
+ * @param organism  the rtNEAT organism
+ */
+void Population::discard(NEAT::Organism *organism) {
+    if(m_lineage) m_lineage->death(organism, m_numOffspring, true);
+    restore(organism);
+    removeOrganism(organism);
+    m_numRejected++;
+}
+
+/**
+ * Take a candidate out of its species, and the species out of the
+ * population if that leaves it empty, so that reproduction can't choose it
+ * as a parent. The candidate keeps its species pointer for restore().
+ * 
+ * @param organism  the rtNEAT organism
+ */
+void Population::withhold(NEAT::Organism *organism) {
+    NEAT::Species *species = organism->species;
+    species->remove_org(organism);
+    if(species->organisms.empty()) {
+        std::vector<NEAT::Species*> &all = m_population->species;
+        all.erase(std::find(all.begin(), all.end(), species));
+    }
+}
+
+/**
+ * Put a withheld candidate back into its species, and the species back into
+ * the population if it was withheld too.
+ * 
+ * @param organism  the rtNEAT organism
+ */
+void Population::restore(NEAT::Organism *organism) {
+    NEAT::Species *species = organism->species;
+    if(species->organisms.empty())
+        m_population->species.push_back(species);
+    species->add_Organism(organism);
+}
+
+/**
+ * Remove an rtNEAT organism from its species, deleting the species if that
+ * leaves it empty, and from the population, and delete it.
+ * 
+ * @param organism  the rtNEAT organism
+ */
+void Population::removeOrganism(NEAT::Organism *organism) {
+    NEAT::Species *species = organism->species;
+    species->remove_org(organism);
+    if(species->organisms.empty()) {
+        std::vector<NEAT::Species*> &all = m_population->species;
+        all.erase(std::find(all.begin(), all.end(), species));
+        delete species;
+    }
+    // search from the back, where reproduce_one() appends, so that discarding
+    // a candidate costs nothing like a scan of the population
+    std::vector<NEAT::Organism*> &organisms = m_population->organisms;
+    std::vector<NEAT::Organism*>::reverse_iterator i =
+        std::find(organisms.rbegin(), organisms.rend(), organism);
+    organisms.erase(--i.base());
+    delete organism;
 }
 
 /**
@@ -137,13 +593,61 @@ void Population::evolvePopulation() {
  * @return  the organism
  */
 NEAT::Organism *Population::reproduce() {
+    if(checkIndex) checkAverages();
     for(std::vector<NEAT::Species*>::iterator
         i = m_population->species.begin(), e = m_population->species.end();
         i != e; i++) // re-estimate average fitness of all species
-        (*i)->estimate_average();
+        (*i)->average_est = m_index.averageEstimate(*i);
     fprintf(stderr, "producing offspring #%d\n", m_numOffspring);
-    return m_population->choose_parent_species()->reproduce_one(
-        m_numOffspring++, m_population, m_population->species);
+    NEAT::Species *species = m_population->choose_parent_species();
+    NEAT::Organism *baby;
+    {
+        ArenaScope scope;
+        baby = species->reproduce_one(
+            m_numOffspring++, m_population, m_population->species);
+    }
+    if(m_lineage) {
+        // reproduce_one() doesn't report the parents, so guess them as the
+        // closest genomes in the parent species; a father from another
+        // species, which rtNEAT rarely picks, is missed
+        NEAT::Organism *mother = closestOrganism(
+            baby, species->organisms, NULL, !baby->mate_baby);
+        NEAT::Organism *father = baby->mate_baby ?
+            closestOrganism(baby, species->organisms, mother, false) : NULL;
+        m_lineage->birth(baby, mother, father, m_numOffspring, true);
+    }
+    return baby;
+}
+
+/**
+ * Find the organism whose genome is most compatible with the given one.
+ * 
+ * @param organism    the rtNEAT organism
+ * @param candidates  the rtNEAT organisms to search
+ * @param exclude     an rtNEAT organism to skip besides the given one
+ * @param cloned      true if the organism was cloned from the one sought and
+ *                    mutated, which adds at most two genes and removes none,
+ *                    so that only candidates of such sizes need comparing
+ * @return            the closest candidate, or NULL if there are none
+ */
+NEAT::Organism *Population::closestOrganism(NEAT::Organism *organism,
+        std::vector<NEAT::Organism*> &candidates, NEAT::Organism *exclude,
+        bool cloned) {
+    NEAT::Organism *closest = NULL;
+    double closestDistance = 0;
+    int numGenes = organism->gnome->genes.size();
+    for(std::vector<NEAT::Organism*>::iterator
+        i = candidates.begin(), e = candidates.end(); i != e; i++) {
+        if(*i == organism || *i == exclude) continue;
+        int extra = numGenes - (int) (*i)->gnome->genes.size();
+        if(cloned && (extra < 0 || extra > 2)) continue;
+        double distance = organism->gnome->compatibility((*i)->gnome);
+        if(!closest || distance < closestDistance) {
+            closest = *i;
+            closestDistance = distance;
+        }
+    }
+    return closest;
 }
 
 /**
@@ -154,28 +658,181 @@ NEAT::Organism *Population::reproduce() {
  */
 void Population::replaceOrganism(NEAT::Organism *oldOrganism,
                                  NEAT::Organism *newOrganism) {
-    for(int i = 0; i < NEAT::pop_size; i++) {
-        Organism *organism = m_organisms[i];
-        if(organism->getNEATOrganism() == oldOrganism) {
-            organism->setNEATOrganism(newOrganism);
-            organism->spawn();
-        }
+    int slot = slotOf(oldOrganism);
+    if(slot >= 0) refill(slot, newOrganism);
+}
+
+/**
+ * Give a slot a new rtNEAT organism, and spawn it.
+ * 
+ * @param slot      the slot
+ * @param organism  the new rtNEAT organism
+ */
+void Population::refill(int slot, NEAT::Organism *organism) {
+    bind(slot, organism);
+    m_organisms[slot].spawn();
+    if(trace) {
+        trace->death(slot);
+        trace->birth(slot, organism->gnome->genome_id);
     }
 }
 
+/**
+ * Return the slot holding the given rtNEAT organism.
+ * 
+ * @param organism  the rtNEAT organism
+ * @return          the slot, or -1 if it is not in the population
+ */
+int Population::slotOf(NEAT::Organism *organism) {
+    std::tr1::unordered_map<NEAT::Organism*, int>::iterator
+        i = m_slots.find(organism);
+    return i == m_slots.end() ? -1 : i->second;
+}
+
+/**
+ * Put an rtNEAT organism in the given slot, in place of its current one.
+ * 
+ * @param slot      the slot
+ * @param organism  the rtNEAT organism
+ */
+void Population::bind(int slot, NEAT::Organism *organism) {
+    m_slots.erase(m_organisms[slot].getNEATOrganism());
+    m_slots[organism] = slot;
+    m_organisms[slot].setNEATOrganism(organism);
+    if(slot < m_indexedActive) m_index.update(slot, organism);
+    else m_index.remove(slot); // suspended
+}
+
+/**
+ * Note that the fitness of the organism in the given slot has changed, or
+ * that it has come of age, so that the next commit updates the index.
+ * 
+ * @param slot  the slot
+ */
+void Population::markDirty(int slot) {
+    if(m_dirty[slot]) return;
+    m_dirty[slot] = true;
+    m_dirtySlots.push_back(slot);
+}
+
+/**
+ * Bring the index in line with the active slots, then copy the current
+ * fitness and age of each organism marked dirty to its rtNEAT organism, and
+ * update the index for it. Only evaluations change fitness or eligibility, so
+ * the ages of the others may lag until then.
+ */
+void Population::commit() {
+    for(int i = m_active; i < m_indexedActive; i++) // newly suspended
+        m_index.remove(i);
+    for(int i = m_indexedActive; i < m_active; i++) // newly restored
+        if(m_organisms[i].getNEATOrganism())
+            m_index.update(i, m_organisms[i].getNEATOrganism());
+    m_indexedActive = m_active;
+    for(size_t j = 0; j < m_dirtySlots.size(); j++) {
+        int i = m_dirtySlots[j];
+        m_dirty[i] = false;
+        NEAT::Organism *organism = m_organisms[i].getNEATOrganism();
+        if(!organism) continue; // parked
+        m_organisms[i].commit();
+        if(i < m_indexedActive) m_index.update(i, organism);
+    }
+    m_dirtySlots.clear();
+}
+
+/**
+ * Update the index for the rtNEAT organism in the given slot, unless the slot
+ * is vacant.
+ * 
+ * @param slot  the slot
+ */
+void Population::reindex(int slot) {
+    if(m_index.contains(slot))
+        m_index.update(slot, m_organisms[slot].getNEATOrganism());
+}
+
 /**
  * Reassign the organisms to different species if necessary.
  */
 void Population::reassignSpecies() {
-    if(m_numOffspring % (NEAT::pop_size/8) != 0) return;
+    // rejected candidates never lived, so only count those admitted
+    if((m_numOffspring - m_numRejected) % (m_size/8) != 0) return;
     int numSpecies = m_population->species.size();
-    if(numSpecies < NUM_SPECIES_TARGET)
-        NEAT::compat_threshold -= COMPATIBILITY_THRESHOLD_DELTA;
-    else if(numSpecies > NUM_SPECIES_TARGET)
-        NEAT::compat_threshold += COMPATIBILITY_THRESHOLD_DELTA;
+    if(numSpecies < numSpeciesTarget)
+        NEAT::compat_threshold -= compatibilityThresholdDelta;
+    else if(numSpecies > numSpeciesTarget)
+        NEAT::compat_threshold += compatibilityThresholdDelta;
     if(NEAT::compat_threshold < 0.3) NEAT::compat_threshold = 0.3;
     for(std::vector<NEAT::Organism*>::iterator
         i = m_population->organisms.begin(), e = m_population->organisms.end();
         i != e; i++)
         m_population->reassign_species(*i);
+    for(int i = 0; i < m_size; i++) // organisms may have changed species
+        reindex(i);
+    m_index.resum();
+}
+
+/**
+ * Check the slot chosen by the index against a full scan for the organism
+ * with the lowest adjusted fitness, as remove_worst() does it, and exit if
+ * they disagree.
+ * 
+ * @param slot  the slot chosen by the index, or -1 if none
+ */
+void Population::checkWorst(int slot) {
+    NEAT::Organism *worst = NULL;
+    double worstFitness = 0;
+    for(int i = 0; i < m_size; i++) {
+        if(!m_index.contains(i)) continue;
+        NEAT::Organism *organism = m_organisms[i].getNEATOrganism();
+        if(organism->time_alive < NEAT::time_alive_minimum) continue;
+        double fitness =
+            organism->fitness / organism->species->organisms.size();
+        if(!worst || fitness < worstFitness) {
+            worst = organism;
+            worstFitness = fitness;
+        }
+    }
+    bool agree = worst ? slot >= 0
+        && fabs(m_index.adjustedFitness(slot) - worstFitness)
+           <= 1e-6 * fabs(worstFitness) : slot < 0;
+    if(!agree) {
+        fprintf(stderr, "fitness index chose slot %d, but a scan found %s "
+            "with adjusted fitness %g\n", slot, worst ? "one" : "none",
+            worstFitness);
+        exit(1);
+    }
+}
+
+/**
+ * Check the index's estimate of each species' average fitness against
+ * estimate_average(), and exit if they disagree.
+ */
+void Population::checkAverages() {
+    for(std::vector<NEAT::Species*>::iterator
+        i = m_population->species.begin(), e = m_population->species.end();
+        i != e; i++) {
+        double scanned = (*i)->estimate_average();
+        double indexed = m_index.averageEstimate(*i);
+        if(fabs(indexed - scanned) > 1e-6 * fabs(scanned)) {
+            fprintf(stderr, "fitness index estimates species #%d at %g, but a "
+                "scan gives %g\n", (*i)->id, indexed, scanned);
+            exit(1);
+        }
+    }
+}
+
+/**
+ * Record the fittest mature organism in the hall of fame, before it can be
+ * lost to remove_worst().
+ */
+void Population::archiveChampion() {
+    NEAT::Organism *champion = NULL;
+    for(std::vector<NEAT::Organism*>::iterator
+        i = m_population->organisms.begin(), e = m_population->organisms.end();
+        i != e; i++)
+        if((*i)->time_alive >= NEAT::time_alive_minimum
+           && (!champion || (*i)->fitness > champion->fitness))
+            champion = *i;
+    if(champion && champion->fitness > 0)
+        archive->record(champion->gnome, champion->fitness);
 }
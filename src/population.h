@@ -23,46 +23,159 @@
 #ifndef POPULATION_H
 #define POPULATION_H
 
+#include <tr1/unordered_map>
+
+#include <pthread.h>
+
+#include "fitnessindex.h"
+
 #include <Box2D.h>
 #include <NEAT/genome.h>
 #include <NEAT/organism.h>
 #include <NEAT/population.h>
 
+class Archive;
+struct EvaluationCounters;
+class Governor;
 class Level;
+class Lineage;
 class Organism;
+class Sandbox;
+class Stats;
+class Trace;
 
 class Population {
 public:
     /** Should evolution occur? */
     bool evolve;
+    /** Live statistics, or NULL if disabled */
+    Stats *stats;
+    /** Hall of fame to record champions to, or NULL if disabled */
+    Archive *archive;
+    /** Trajectory recorder, or NULL if disabled */
+    Trace *trace;
+    /** Sandbox to screen offspring in, or NULL to admit them unscreened */
+    Sandbox *sandbox;
+    /** Governor to report the cost of the organisms to, or NULL */
+    Governor *governor;
+    /**
+     * Proportion of the population that is ineligible for removal at any
+     * time, evolution being spaced lifetime / (proportion * active) apart
+     */
+    static double ineligibleProportion;
+    /** Number of species that the compatibility threshold aims for */
+    static int numSpeciesTarget;
+    /** Step by which the compatibility threshold is adjusted */
+    static double compatibilityThresholdDelta;
+    /** Should reproduction and speciation run on a background thread? */
+    static bool asyncEvolution;
+    /** Number of candidates screened together in a sandbox, or 0 if none */
+    static int screenBatch;
+    /** Proportion of the mean score of those admitted that admits another */
+    static double screenThreshold;
+    /** Should the fitness index be checked against full scans? */
+    static bool checkIndex;
     
-    Population(Level *level, int lifetime);
-    ~Population();
+    Population(Level *level, int lifetime, int size = 0);
+    virtual ~Population();
     void setLifetime(int lifetime);
     void spawn();
     void step();
     Organism *find(b2Body *body);
+    double bestFitness();
+    bool busy();
+    Organism *getOrganism(int i);
+    int getSize();
+    void setActive(int active);
+    int getActive();
+    NEAT::Population *getNEATPopulation();
+    int getNumOffspring();
+    void markDirty(int slot);
+    void setNEATOrganism(int i, NEAT::Organism *organism);
+    void seed(std::vector<NEAT::Genome*> &genomes);
+    void setLineage(Lineage *lineage);
+    virtual void getCounters(EvaluationCounters &counters);
     
 protected:
+    /** Number of organisms in the population */
+    int m_size;
+    /** Number of organisms stepped; the others are suspended */
+    int m_active;
+    /** Number of leading slots the index covers, which catches up with
+        m_active at the next commit */
+    int m_indexedActive;
+    /** Lifetime of the organisms */
+    int m_lifetime;
     /** Number of offspring born */
     int m_numOffspring;
+    /** Number of candidates screened in the sandbox */
+    long long m_numScreened;
+    /** Number of candidates rejected by screening */
+    long long m_numRejected;
+    /** Number of candidates admitted after screening */
+    long long m_numAdmitted;
+    /** Sum of the sandbox scores of all candidates admitted */
+    double m_totalAdmittedScore;
     /** Number of ticks between evolution */
     int m_evolutionSpacing;
     /** Number of ticks since the last evolution */
     int m_ticksSinceEvolution;
-    /** Array of organisms in this population */
-    Organism **m_organisms;
+    /** Array of organisms in this population, indexed by slot */
+    Organism *m_organisms;
+    /** Slot of each rtNEAT organism in the population */
+    std::tr1::unordered_map<NEAT::Organism*, int> m_slots;
     /** Level this population lives in */
     Level *m_level;
     /** The rtNEAT population */
     NEAT::Population *m_population;
+    /** Committed fitness of each slot, by species */
+    FitnessIndex m_index;
+    /** Slots whose fitness or age has changed since the last commit */
+    std::vector<int> m_dirtySlots;
+    std::vector<bool> m_dirty;
+    /** Log of births and deaths, or NULL if disabled */
+    Lineage *m_lineage;
+    
+    /** States of the background evolution thread */
+    enum EvolutionJob { JOB_IDLE, JOB_REQUESTED, JOB_DONE, JOB_STOP };
+    /** Background evolution thread, if started */
+    pthread_t m_evolutionThread;
+    bool m_evolutionStarted;
+    /** Guards m_job and m_offspring */
+    pthread_mutex_t m_evolutionLock;
+    pthread_cond_t m_evolutionChanged;
+    EvolutionJob m_job;
+    /** Slot whose organism was removed and awaits the offspring, or -1 */
+    int m_parkedSlot;
+    /** The offspring produced by the background thread */
+    NEAT::Organism *m_offspring;
     
     void generatePopulation(NEAT::Genome *starterGenome);
     void evolvePopulation();
+    NEAT::Organism *removeWorst();
+    void evolveAsync();
+    static void *runEvolution(void *population);
+    NEAT::Organism *breed();
+    NEAT::Organism *screenOffspring();
+    void discard(NEAT::Organism *organism);
+    void withhold(NEAT::Organism *organism);
+    void restore(NEAT::Organism *organism);
+    void removeOrganism(NEAT::Organism *organism);
     NEAT::Organism *reproduce();
-    void replaceOrganism(NEAT::Organism *oldOrganism,
-                         NEAT::Organism *newOrganism);
+    NEAT::Organism *closestOrganism(NEAT::Organism *organism,
+                                    std::vector<NEAT::Organism*> &candidates,
+                                    NEAT::Organism *exclude, bool cloned);
+    virtual void replaceOrganism(NEAT::Organism *oldOrganism,
+                                 NEAT::Organism *newOrganism);
+    void refill(int slot, NEAT::Organism *organism);
+    int slotOf(NEAT::Organism *organism);
+    void bind(int slot, NEAT::Organism *organism);
+    void commit();
+    void reindex(int slot);
+    void checkWorst(int slot);
+    void checkAverages();
     void reassignSpecies();
+    void archiveChampion();
 };
 
 #endif
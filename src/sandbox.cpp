@@ -0,0 +1,120 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#include "sandbox.h"
+#include "arena.h"
+#include "level.h"
+#include "organism.h"
+#include "population.h"
+
+#include <algorithm>
+
+#include <NEAT/genome.h>
+#include <NEAT/neat.h>
+
+/**
+ * Create a sandbox of the given level.
+ * 
+ * @param levelFile  the name of the file describing the level
+ * @param batchSize  the number of candidates to simulate together
+ */
+Sandbox::Sandbox(const char *levelFile, int batchSize)
+    : m_batchSize(batchSize), m_ticks(0),
+      m_owned(batchSize, (NEAT::Organism *) NULL) {
+    int lifetime = NEAT::time_alive_minimum; // the level would reset it
+    m_level = new Level(levelFile, batchSize);
+    NEAT::time_alive_minimum = lifetime;
+    m_level->isolated = true;
+    m_level->getPopulation()->evolve = false;
+    m_level->setPhysics((double) SANDBOX_TIMESTEP_SCALE / FRAME_RATE,
+                        SANDBOX_ITERATIONS);
+    m_level->setGoal(m_level->getGoal()); // no scheduled moves
+    m_horizon = (int) (SANDBOX_HORIZON * Level::readLifetime(levelFile)
+                       / SANDBOX_TIMESTEP_SCALE);
+    if(m_horizon < 1) m_horizon = 1;
+}
+
+Sandbox::~Sandbox() {
+    delete m_level;
+    for(size_t i = 0; i < m_owned.size(); i++)
+        delete m_owned[i];
+}
+
+/**
+ * Score the given candidates, a batch at a time. The candidates themselves
+ * are left untouched; the sandbox simulates copies of them.
+ * 
+ * @param candidates  the rtNEAT organisms to score
+ * @param scores      set to the score of each candidate
+ */
+void Sandbox::evaluate(const std::vector<NEAT::Organism*> &candidates,
+                       std::vector<double> &scores) {
+    Population *population = m_level->getPopulation();
+    scores.assign(candidates.size(), 0.0);
+    for(size_t first = 0; first < candidates.size(); first += m_batchSize) {
+        int n = std::min((size_t) m_batchSize, candidates.size() - first);
+        for(int j = 0; j < n; j++) {
+            NEAT::Genome *genome = candidates[first + j]->gnome;
+            ArenaScope scope;
+            NEAT::Organism *copy = new NEAT::Organism(0.0,
+                genome->duplicate(genome->genome_id), 0);
+            population->setNEATOrganism(j, copy);
+            delete m_owned[j]; // the originals belong to the level
+            m_owned[j] = copy;
+        }
+        for(int t = 0; t < m_horizon; t++) {
+            m_level->step();
+            for(int j = 0; j < n; j++)
+                scores[first + j] += population->getOrganism(j)->score;
+        }
+        for(int j = 0; j < n; j++)
+            scores[first + j] /= m_horizon;
+        m_ticks += m_horizon;
+    }
+}
+
+/**
+ * Move the sandbox's goal, to follow the live level's.
+ * 
+ * @param goal  the new goal
+ */
+void Sandbox::setGoal(b2Vec2 goal) {
+    m_level->setGoal(goal);
+}
+
+/**
+ * Return the number of candidates simulated together.
+ * 
+ * @return  the batch size
+ */
+int Sandbox::getBatchSize() {
+    return m_batchSize;
+}
+
+/**
+ * Return the number of low-fidelity ticks simulated so far.
+ * 
+ * @return  the number of ticks
+ */
+long long Sandbox::getTicks() {
+    return m_ticks;
+}
@@ -0,0 +1,70 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#ifndef SANDBOX_H
+#define SANDBOX_H
+
+#include <vector>
+
+#include <Box2D.h>
+#include <NEAT/organism.h>
+
+#define SANDBOX_TIMESTEP_SCALE 3 /* sandbox steps are this many frames long */
+#define SANDBOX_ITERATIONS 3     /* constraint solver iterations per step */
+#define SANDBOX_HORIZON 0.5      /* proportion of a lifetime to simulate */
+
+class Level;
+
+/**
+ * A private, low-fidelity copy of a level for screening new offspring before
+ * they are let into the live world. A whole batch of candidates is simulated
+ * together with a coarser timestep and fewer solver iterations, for part of a
+ * lifetime, and each is scored by its mean closeness to the goal.
+ * 
+ * The sandbox is independent of the live level, so it may be used from the
+ * background evolution thread. Its organisms stay out of shared statistics,
+ * early termination and novelty search.
+ */
+class Sandbox {
+public:
+    Sandbox(const char *levelFile, int batchSize);
+    ~Sandbox();
+    void evaluate(const std::vector<NEAT::Organism*> &candidates,
+                  std::vector<double> &scores);
+    void setGoal(b2Vec2 goal);
+    int getBatchSize();
+    long long getTicks();
+    
+protected:
+    /** The sandbox's own level, holding one batch of organisms */
+    Level *m_level;
+    /** Number of candidates simulated together */
+    int m_batchSize;
+    /** Ticks to simulate each batch for */
+    int m_horizon;
+    /** Number of ticks simulated so far */
+    long long m_ticks;
+    /** The copy of each slot's rtNEAT organism owned by the sandbox */
+    std::vector<NEAT::Organism*> m_owned;
+};
+
+#endif
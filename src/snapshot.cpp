@@ -0,0 +1,128 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#include "snapshot.h"
+#include "debugdraw.h"
+#include "level.h"
+#include "organism.h"
+#include "population.h"
+
+#include <cmath>
+
+#include <NEAT/neat.h>
+
+SnapshotBuffer::SnapshotBuffer() : m_back(0), m_front(1), m_middle(2) {
+    for(int i = 0; i < 3; i++)
+        m_buffers[i].tick = -1;
+}
+
+/**
+ * Record the ground of the given level, before any snapshots are published.
+ * 
+ * @param level  the level
+ */
+void SnapshotBuffer::init(Level *level) {
+    level->groundPolygons(m_ground);
+}
+
+/**
+ * Publish the state of the given level. Called by the simulation thread.
+ * 
+ * @param level  the level
+ * @param tick   the number of ticks elapsed
+ */
+void SnapshotBuffer::publish(Level *level, int64_t tick) {
+    Snapshot &snapshot = m_buffers[m_back];
+    Population *population = level->getPopulation();
+    snapshot.tick = tick;
+    snapshot.goal = level->getGoal();
+    snapshot.bodies.resize(population->getSize()); // allocates the first time
+    for(int i = 0; i < population->getSize(); i++) {
+        Organism *organism = population->getOrganism(i);
+        b2Body *body = organism->getBody();
+        SnapshotBody &b = snapshot.bodies[i];
+        b2Vec2 p = organism->position();
+        b.x = p.x;
+        b.y = p.y;
+        b.angle = body ? body->GetAngle() : 0; // no body while parked
+        b.sleeping = !body || body->IsSleeping();
+    }
+    m_back = exchange(&m_middle, m_back | SNAPSHOT_FRESH) & ~SNAPSHOT_FRESH;
+}
+
+/**
+ * Return the newest snapshot, which remains valid until the next call.
+ * Called by the render thread.
+ * 
+ * @return  the snapshot, whose tick is -1 if none has been published yet
+ */
+const Snapshot *SnapshotBuffer::acquire() {
+    if(m_middle & SNAPSHOT_FRESH)
+        m_front = exchange(&m_middle, m_front) & ~SNAPSHOT_FRESH;
+    return &m_buffers[m_front];
+}
+
+/**
+ * Return the polygons making up the ground.
+ */
+const std::vector<std::vector<b2Vec2> > &SnapshotBuffer::ground() {
+    return m_ground;
+}
+
+/**
+ * Atomically replace an integer, with a full memory barrier.
+ * 
+ * @param p      the integer
+ * @param value  the new value
+ * @return       the old value
+ */
+int SnapshotBuffer::exchange(volatile int *p, int value) {
+    int old;
+    do {
+        old = *p;
+    } while(!__sync_bool_compare_and_swap(p, old, value));
+    return old;
+}
+
+/**
+ * Draw a snapshot of a level, in the colours b2World uses for debug drawing.
+ * 
+ * @param draw      the renderer
+ * @param ground    the polygons making up the ground
+ * @param snapshot  the snapshot
+ */
+void drawSnapshot(DebugDraw &draw,
+                  const std::vector<std::vector<b2Vec2> > &ground,
+                  const Snapshot &snapshot) {
+    for(size_t i = 0; i < ground.size(); i++)
+        draw.DrawSolidPolygon(&ground[i][0], ground[i].size(),
+                              b2Color(0.5, 0.9, 0.5));
+    for(size_t i = 0; i < snapshot.bodies.size(); i++) {
+        const SnapshotBody &b = snapshot.bodies[i];
+        b2Color color = b.sleeping ? b2Color(0.5, 0.5, 0.9)
+                                   : b2Color(0.9, 0.9, 0.9);
+        draw.DrawSolidCircle(b2Vec2(b.x, b.y), 1.0,
+                             b2Vec2(cos(b.angle), sin(b.angle)), color);
+    }
+    draw.DrawSolidCircle(snapshot.goal, 5.0, b2Vec2_zero,
+                         b2Color(0.0, 0.5, 1.0));
+}
@@ -0,0 +1,84 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <Box2D.h>
+
+#define SNAPSHOT_FRESH 4 /* flag on the middle buffer's index */
+
+class DebugDraw;
+class Level;
+
+/** The drawable state of an organism */
+struct SnapshotBody {
+    float x, y;
+    float angle;
+    int32_t sleeping;
+};
+
+/** The drawable state of a level at the end of a tick */
+struct Snapshot {
+    int64_t tick;
+    b2Vec2 goal;
+    std::vector<SnapshotBody> bodies;
+};
+
+/**
+ * Hands the newest snapshot of a level from the simulation thread to the
+ * render thread without either ever waiting for the other. Of three buffers,
+ * the writer owns one and the reader another; the third is exchanged
+ * atomically by whichever side has finished with its own, so a slow reader
+ * just skips snapshots and a slow writer just repeats frames.
+ */
+class SnapshotBuffer {
+public:
+    SnapshotBuffer();
+    void init(Level *level);
+    void publish(Level *level, int64_t tick);
+    const Snapshot *acquire();
+    const std::vector<std::vector<b2Vec2> > &ground();
+    
+protected:
+    Snapshot m_buffers[3];
+    /** The buffer being written, owned by the writer */
+    int m_back;
+    /** The buffer being drawn, owned by the reader */
+    int m_front;
+    /** The spare buffer, with SNAPSHOT_FRESH set if not yet read */
+    volatile int m_middle;
+    /** The ground, which never changes */
+    std::vector<std::vector<b2Vec2> > m_ground;
+    
+    static int exchange(volatile int *p, int value);
+};
+
+void drawSnapshot(DebugDraw &draw,
+                  const std::vector<std::vector<b2Vec2> > &ground,
+                  const Snapshot &snapshot);
+
+#endif
@@ -0,0 +1,217 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#include "stats.h"
+#include "arena.h"
+#include "governor.h"
+#include "level.h"
+#include "population.h"
+#include "organism.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <NEAT/species.h>
+
+/**
+ * Return the time from a monotonic clock.
+ * 
+ * @return  the time in seconds
+ */
+double statsClock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+Stats::Stats()
+    : m_header(NULL), m_size(0), m_tick(0), m_ticksSinceSample(0),
+      m_sampleTime(statsClock()), m_governor(NULL) {
+    memset(m_phaseTime, 0, sizeof(m_phaseTime));
+}
+
+Stats::~Stats() {
+    if(m_header) munmap(m_header, m_size);
+}
+
+/**
+ * Create the statistics file and map it into memory.
+ * 
+ * @param filename      the name of the file to publish to
+ * @param level         the name of the level being run
+ * @param maxOrganisms  the maximum number of organism positions per sample
+ * @return              true on success
+ */
+bool Stats::open(const char *filename, const char *level, int maxOrganisms) {
+    uint32_t slotSize = statsSlotSize(maxOrganisms);
+    m_size = sizeof(StatsHeader) + STATS_NUM_SLOTS * slotSize;
+    int fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        perror(filename);
+        return false;
+    }
+    if(ftruncate(fd, m_size) < 0) {
+        perror(filename);
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        perror(filename);
+        return false;
+    }
+    m_header = (StatsHeader *) map;
+    m_header->version = STATS_VERSION;
+    m_header->pid = getpid();
+    m_header->maxOrganisms = maxOrganisms;
+    m_header->slotSize = slotSize;
+    m_header->numSlots = STATS_NUM_SLOTS;
+    m_header->head = 0;
+    strncpy(m_header->level, level, sizeof(m_header->level) - 1);
+    __sync_synchronize();
+    m_header->magic = STATS_MAGIC; // readers ignore the file until now
+    return true;
+}
+
+/**
+ * Accumulate time spent in the given phase of the current tick.
+ * 
+ * @param phase    the phase
+ * @param seconds  the time spent
+ */
+void Stats::addPhaseTime(int phase, double seconds) {
+    m_phaseTime[phase] += seconds;
+}
+
+/**
+ * Publish the decisions of the given governor along with the statistics.
+ * 
+ * @param governor  the governor, or NULL
+ */
+void Stats::setGovernor(Governor *governor) {
+    m_governor = governor;
+}
+
+/**
+ * Mark the end of a tick.
+ * 
+ * @return  true if a sample is due to be published
+ */
+bool Stats::tick() {
+    m_tick++;
+    return ++m_ticksSinceSample >= STATS_PERIOD;
+}
+
+/**
+ * Publish a sample of the given population to the next slot of the ring.
+ * 
+ * @param population  the population
+ */
+void Stats::publish(Population *population) {
+    double now = statsClock();
+    uint32_t next = m_header->head + 1;
+    StatsSlot *slot = statsSlot(m_header, next);
+    StatsSample *sample = &slot->sample;
+    slot->seq++;
+    __sync_synchronize();
+    
+    sample->tick = m_tick;
+    sample->tickRate = m_ticksSinceSample / (now - m_sampleTime);
+    for(int i = 0; i < STATS_NUM_PHASES; i++) {
+        sample->phaseTime[i] = m_phaseTime[i] / m_ticksSinceSample;
+        m_phaseTime[i] = 0;
+    }
+    m_ticksSinceSample = 0;
+    m_sampleTime = now;
+    
+    NEAT::Population *pop = population->getNEATPopulation();
+    EvaluationCounters counters;
+    population->getCounters(counters);
+    sample->terminations = counters.terminations;
+    sample->savedTicks = counters.savedTicks;
+    sample->organismTicks = counters.totalTicks;
+    sample->fullQueries = counters.fullQueries;
+    sample->cachedQueries = counters.cachedQueries;
+    ArenaStats arena;
+    arenaStats(&arena);
+    sample->heapBytes = arena.bytesInUse;
+    sample->heapPeak = arena.peakBytes;
+    sample->heapSlabs = arena.slabs;
+    sample->activeOrganisms = 0;
+    if(m_governor) {
+        sample->tickBudget = m_governor->getBudget();
+        sample->tickCost = m_governor->getTickCost();
+        sample->organismCost = m_governor->getOrganismCost();
+        sample->activeOrganisms = m_governor->getActive();
+        sample->solverIterations = m_governor->getIterations();
+        sample->controlPeriod = m_governor->getControlPeriod();
+        sample->refreshPeriod = m_governor->getRefreshPeriod();
+    }
+    if(population->busy()) { // repeat what the previous sample saw
+        StatsSample *previous = &statsSlot(m_header, m_header->head)->sample;
+        sample->numOffspring = previous->numOffspring;
+        sample->compatThreshold = previous->compatThreshold;
+        sample->numSpecies = previous->numSpecies;
+        memcpy(sample->species, previous->species, sizeof(sample->species));
+    } else {
+        sample->numOffspring = population->getNumOffspring();
+        sample->compatThreshold = NEAT::compat_threshold;
+        sample->numSpecies = 0;
+        for(std::vector<NEAT::Species*>::iterator
+            i = pop->species.begin(), e = pop->species.end();
+            i != e && sample->numSpecies < STATS_MAX_SPECIES; i++) {
+            StatsSpecies *species = &sample->species[sample->numSpecies++];
+            species->id = (*i)->id;
+            species->size = (*i)->organisms.size();
+            species->averageEst = (*i)->average_est;
+        }
+    }
+    
+    double best = 0, total = 0;
+    float *positions = statsPositions(sample);
+    sample->numOrganisms = 0;
+    for(int i = 0; i < population->getSize(); i++) {
+        Organism *organism = population->getOrganism(i);
+        double fitness = organism->getFitness();
+        total += fitness;
+        if(i == 0 || fitness > best) best = fitness;
+        if(i < m_header->maxOrganisms) {
+            b2Vec2 p = organism->position();
+            positions[2*i] = p.x;
+            positions[2*i+1] = p.y;
+            sample->numOrganisms++;
+        }
+    }
+    sample->bestFitness = best;
+    sample->meanFitness = total / population->getSize();
+    
+    __sync_synchronize();
+    slot->seq++;
+    __sync_synchronize();
+    m_header->head = next;
+}
@@ -0,0 +1,195 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#define STATS_MAGIC 0x5354424e /* "NBTS" */
+#define STATS_VERSION 6
+#define STATS_NUM_SLOTS 4
+#define STATS_MAX_SPECIES 64
+#define STATS_PERIOD 6 /* ticks between samples */
+
+/** Phases of a tick which are timed separately */
+enum StatsPhase {
+    STATS_PHASE_ORGANISMS, /* sensing, activation and acting */
+    STATS_PHASE_EVOLUTION, /* remove_worst, reproduction and speciation */
+    STATS_PHASE_PHYSICS,   /* b2World::Step and publishing snapshots */
+    STATS_NUM_PHASES
+};
+
+/** Live statistics for a single species */
+struct StatsSpecies {
+    int32_t id;
+    int32_t size;
+    float averageEst;
+};
+
+/**
+ * A sample of the live statistics. Each sample is followed in memory by
+ * maxOrganisms (x, y) position pairs, of which numOrganisms are valid.
+ */
+struct StatsSample {
+    int64_t tick;
+    double tickRate;
+    double phaseTime[STATS_NUM_PHASES];
+    int32_t numOffspring;
+    float compatThreshold;
+    float bestFitness;
+    float meanFitness;
+    int32_t numSpecies;
+    int32_t numOrganisms;
+    /** Evaluations terminated early, and organism-ticks saved by doing so */
+    int64_t terminations;
+    int64_t savedTicks;
+    int64_t organismTicks;
+    /** Rays answered by full queries, and from the sensor cache */
+    int64_t fullQueries;
+    int64_t cachedQueries;
+    /** Bytes of genome and network objects in use and at peak, and slabs */
+    int64_t heapBytes;
+    int64_t heapPeak;
+    int64_t heapSlabs;
+    /**
+     * Decisions of the real-time governor, if any: the budget and measured
+     * cost of a tick and of an active organism, in seconds, and the settings
+     * chosen; activeOrganisms is 0 without a governor
+     */
+    float tickBudget;
+    float tickCost;
+    float organismCost;
+    int32_t activeOrganisms;
+    int32_t solverIterations;
+    int32_t controlPeriod;
+    int32_t refreshPeriod;
+    StatsSpecies species[STATS_MAX_SPECIES];
+};
+
+/** A slot in the ring, guarded by its own sequence lock */
+struct StatsSlot {
+    /** Odd while the slot is being written */
+    volatile uint32_t seq;
+    uint32_t pad;
+    StatsSample sample;
+};
+
+/** The header at the start of a statistics file */
+struct StatsHeader {
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid;
+    int32_t maxOrganisms;
+    uint32_t slotSize;
+    uint32_t numSlots;
+    /** Number of samples published so far */
+    volatile uint32_t head;
+    uint32_t pad;
+    char level[64];
+};
+
+/**
+ * Return the position array following the given sample.
+ */
+inline float *statsPositions(StatsSample *sample) {
+    return (float *) (sample + 1);
+}
+
+/**
+ * Return the size in bytes of a slot holding the given number of organisms.
+ */
+inline uint32_t statsSlotSize(int maxOrganisms) {
+    return (sizeof(StatsSlot) + 2 * sizeof(float) * maxOrganisms + 7) & ~7;
+}
+
+/**
+ * Return the i-th slot of the ring following the given header.
+ */
+inline StatsSlot *statsSlot(StatsHeader *header, uint32_t i) {
+    return (StatsSlot *) ((char *) (header + 1)
+        + (i % header->numSlots) * header->slotSize);
+}
+
+double statsClock();
+
+class Governor;
+class Population;
+
+/**
+ * Publishes live statistics to a memory-mapped file, which can be watched by
+ * rtneatbox-top. The writer never blocks: readers detect torn samples using
+ * the per-slot sequence numbers and simply retry.
+ */
+class Stats {
+public:
+    Stats();
+    ~Stats();
+    bool open(const char *filename, const char *level, int maxOrganisms);
+    void addPhaseTime(int phase, double seconds);
+    bool tick();
+    void publish(Population *population);
+    void setGovernor(Governor *governor);
+    
+protected:
+    /** The mapped file */
+    StatsHeader *m_header;
+    /** Size of the mapping */
+    uint32_t m_size;
+    /** Number of ticks elapsed */
+    int64_t m_tick;
+    /** Ticks elapsed since the last sample */
+    int m_ticksSinceSample;
+    /** Wall-clock time of the last sample */
+    double m_sampleTime;
+    /** Phase times accumulated since the last sample */
+    double m_phaseTime[STATS_NUM_PHASES];
+    /** Governor whose decisions to publish, or NULL */
+    Governor *m_governor;
+};
+
+/**
+ * Times consecutive phases of a tick, if statistics are enabled.
+ */
+class StatsTimer {
+public:
+    StatsTimer(Stats *stats)
+        : m_stats(stats), m_time(stats ? statsClock() : 0) {}
+    
+    /**
+     * Attribute the time elapsed since the previous lap to the given phase.
+     * 
+     * @param phase  the phase
+     */
+    void lap(int phase) {
+        if(!m_stats) return;
+        double now = statsClock();
+        m_stats->addPhaseTime(phase, now - m_time);
+        m_time = now;
+    }
+    
+protected:
+    Stats *m_stats;
+    double m_time;
+};
+
+#endif
@@ -0,0 +1,501 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+// rtneatbox-sweep: run a grid or random sample of parameter settings and
+// levels headless across all cores, and tabulate time-to-solve and throughput
+// for each configuration. With a warmup, each level is evolved once up to the
+// given tick and every run branches from it copy-on-write.
+
+#include "level.h"
+#include "arena.h"
+#include "organism.h"
+#include "params.h"
+#include "population.h"
+#include "sandbox.h"
+#include "stats.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <NEAT/neat.h>
+
+/** A parameter varied by the sweep */
+struct Axis {
+    std::string name;
+    /** Values to try, for a grid axis */
+    std::vector<double> values;
+    /** Is the parameter sampled uniformly from [low, high]? */
+    bool random;
+    double low, high;
+};
+
+/** A setting of every axis, on one level */
+struct Config {
+    std::string level;
+    std::vector<double> values;
+};
+
+/** Outcome of a single run, written by the process that ran it */
+struct Result {
+    /** 0 while pending, 1 when done, -1 if the run crashed */
+    volatile int status;
+    int solved;
+    int64_t ticks;
+    double seconds;
+    double bestFitness;
+    int offspring;
+    /** Peak bytes of genome and network objects */
+    int64_t heapPeak;
+};
+
+/** A level evolved up to the warmup tick, and the rtNEAT globals it left */
+struct WarmLevel {
+    Level *level;
+    double compatThreshold;
+    int lifetime;
+};
+
+/** The description of a sweep */
+struct Sweep {
+    std::vector<std::string> levels;
+    std::vector<Axis> axes;
+    int samples;
+    int repeats;
+    double target;
+    int64_t ticks;
+    int64_t warmup;
+    unsigned seed;
+    /** Directory to record a trace of each run into, if not empty */
+    std::string traceDir;
+    
+    std::vector<Config> configs;
+    /** Each level evolved up to the warmup tick, if warming up */
+    std::map<std::string, WarmLevel> warm;
+    bool load(const char *filename);
+    void enumerate(size_t axis, Config &config);
+};
+
+/**
+ * Load a sweep description. Each line gives a key followed by its values:
+ * 
+ *   level FILE          a level to run (may be repeated)
+ *   param NAME V1 V2..  a grid axis over the given values (see params.cpp)
+ *   random NAME LO HI   an axis sampled uniformly at random
+ *   samples N           random samples per grid point (default 1)
+ *   repeats N           runs per configuration (default 1)
+ *   target F            fitness at which a run counts as solved (a score
+ *                       of 1 is within a metre of the goal)
+ *   ticks N             tick budget per run
+ *   warmup N            evolve each level once for N ticks and branch every
+ *                       run from there instead of starting from scratch
+ *   seed N              seed for sampling and for the runs
+ *   trace DIR           record each run to DIR/run-N.trace for replay
+ *   end
+ * 
+ * @param filename  the name of the file
+ * @return          false if the description is invalid
+ */
+bool Sweep::load(const char *filename) {
+    samples = repeats = 1;
+    target = 1e9;
+    ticks = 100 * 1000;
+    warmup = 0;
+    seed = 1;
+    std::ifstream fin(filename);
+    if(!fin) {
+        perror(filename);
+        return false;
+    }
+    std::string line;
+    while(std::getline(fin, line)) {
+        std::istringstream in(line);
+        std::string key;
+        if(!(in >> key) || key[0] == '#') continue;
+        if(key == "end") break;
+        if(key == "level") {
+            std::string level; in >> level;
+            levels.push_back(level);
+        } else if(key == "param" || key == "random") {
+            Axis axis;
+            in >> axis.name;
+            axis.random = (key == "random");
+            double value, dummy;
+            if(axis.random) in >> axis.low >> axis.high;
+            else while(in >> value) axis.values.push_back(value);
+            if(!getParam(axis.name.c_str(), &dummy)
+               || (!axis.random && axis.values.empty())) {
+                fprintf(stderr, "%s: bad axis: %s\n", filename, line.c_str());
+                return false;
+            }
+            axes.push_back(axis);
+        } else if(key == "samples") {
+            in >> samples;
+        } else if(key == "repeats") {
+            in >> repeats;
+        } else if(key == "target") {
+            in >> target;
+        } else if(key == "ticks") {
+            long long n; in >> n; ticks = n;
+        } else if(key == "warmup") {
+            long long n; in >> n; warmup = n;
+        } else if(key == "seed") {
+            in >> seed;
+        } else if(key == "trace") {
+            in >> traceDir;
+        } else {
+            fprintf(stderr, "%s: unknown key: %s\n", filename, key.c_str());
+            return false;
+        }
+    }
+    if(levels.empty()) {
+        fprintf(stderr, "%s: no levels given\n", filename);
+        return false;
+    }
+    for(size_t i = 0; warmup > 0 && i < axes.size(); i++) {
+        if(axes[i].name == "pop_size") {
+            fprintf(stderr, "%s: pop_size cannot vary after a warmup\n",
+                filename);
+            return false;
+        }
+    }
+    
+    srand(seed);
+    bool anyRandom = false;
+    for(size_t i = 0; i < axes.size(); i++)
+        anyRandom = anyRandom || axes[i].random;
+    for(int s = 0; s < (anyRandom ? samples : 1); s++) {
+        for(size_t l = 0; l < levels.size(); l++) {
+            Config config;
+            config.level = levels[l];
+            config.values.resize(axes.size());
+            enumerate(0, config);
+        }
+    }
+    return true;
+}
+
+/**
+ * Add every configuration of the axes from the given one onwards.
+ */
+void Sweep::enumerate(size_t axis, Config &config) {
+    if(axis == axes.size()) {
+        configs.push_back(config);
+        return;
+    }
+    Axis &a = axes[axis];
+    if(a.random) {
+        config.values[axis] = a.low + (a.high - a.low) * rand() / RAND_MAX;
+        enumerate(axis + 1, config);
+    } else {
+        for(size_t i = 0; i < a.values.size(); i++) {
+            config.values[axis] = a.values[i];
+            enumerate(axis + 1, config);
+        }
+    }
+}
+
+/**
+ * Take a job from the front of the given worker's range of jobs. Ranges are
+ * packed as begin | end << 32, so that the owner and thieves can both update
+ * them with a single compare-and-swap.
+ */
+static bool takeFront(volatile uint64_t *range, int *job) {
+    while(true) {
+        uint64_t r = *range;
+        uint32_t begin = r, end = r >> 32;
+        if(begin >= end) return false;
+        if(__sync_bool_compare_and_swap(range, r,
+                                        (uint64_t) end << 32 | (begin + 1))) {
+            *job = begin;
+            return true;
+        }
+    }
+}
+
+/**
+ * Steal a job from the back of another worker's range.
+ */
+static bool takeBack(volatile uint64_t *range, int *job) {
+    while(true) {
+        uint64_t r = *range;
+        uint32_t begin = r, end = r >> 32;
+        if(begin >= end) return false;
+        if(__sync_bool_compare_and_swap(range, r,
+                                        (uint64_t) (end - 1) << 32 | begin)) {
+            *job = end - 1;
+            return true;
+        }
+    }
+}
+
+/**
+ * Evolve each level headless up to the warmup tick, before any workers are
+ * forked, so that every run inherits the warmed-up world and population.
+ * Each level starts from the same rtNEAT globals, as a cold run would, and
+ * the globals it leaves behind are kept for its runs to restore.
+ */
+static void warmUp(Sweep &sweep) {
+    double compatThreshold = NEAT::compat_threshold;
+    fflush(stdout); // stdout carries the results, so silence evolution
+    int saved = dup(1);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+    close(null);
+    for(size_t l = 0; l < sweep.levels.size(); l++) {
+        const std::string &name = sweep.levels[l];
+        if(sweep.warm.count(name)) continue;
+        double start = statsClock();
+        srand(sweep.seed);
+        NEAT::compat_threshold = compatThreshold;
+        WarmLevel warm;
+        warm.level = new Level(name.c_str());
+        for(int64_t t = 0; t < sweep.warmup; t++)
+            warm.level->step();
+        warm.compatThreshold = NEAT::compat_threshold;
+        warm.lifetime = NEAT::time_alive_minimum;
+        sweep.warm[name] = warm;
+        fprintf(stderr, "warmed up %s to tick %lld in %.1fs "
+            "(best fitness %g)\n", name.c_str(), (long long) sweep.warmup,
+            statsClock() - start,
+            warm.level->getPopulation()->bestFitness());
+    }
+    NEAT::compat_threshold = compatThreshold;
+    fflush(stdout);
+    dup2(saved, 1);
+    close(saved);
+}
+
+/**
+ * Run a single configuration headless until it reaches the target fitness or
+ * exhausts its tick budget. Runs in its own process, so that parameters and
+ * the rtNEAT globals start afresh each time, or branch from the warmed-up
+ * level without disturbing it.
+ */
+static void run(Sweep &sweep, Config &config, int index, Result *result) {
+    WarmLevel *warm = sweep.warmup > 0 ? &sweep.warm[config.level] : NULL;
+    if(warm) { // as this level's warmup left them, not the last level's
+        NEAT::compat_threshold = warm->compatThreshold;
+        NEAT::time_alive_minimum = warm->lifetime;
+    }
+    for(size_t i = 0; i < sweep.axes.size(); i++)
+        setParam(sweep.axes[i].name.c_str(), config.values[i]);
+    srand(sweep.seed + index);
+    double start = statsClock();
+    Level *level;
+    if(warm) {
+        level = warm->level;
+        level->setSeed(rand());
+        // the evolution spacing depends on parameters that may have changed
+        level->getPopulation()->setLifetime(NEAT::time_alive_minimum);
+        level->setControlPeriod(Organism::controlPeriod);
+        level->setRefreshPeriod(Organism::sensing.refreshPeriod);
+    } else {
+        level = new Level(config.level.c_str());
+    }
+    Population *population = level->getPopulation();
+    if(Population::screenBatch > 0)
+        population->sandbox =
+            new Sandbox(config.level.c_str(), Population::screenBatch);
+    Trace trace;
+    if(!sweep.traceDir.empty()) {
+        char filename[32];
+        snprintf(filename, sizeof(filename), "/run-%d.trace", index);
+        if(trace.open((sweep.traceDir + filename).c_str(),
+                      config.level.c_str(), level))
+            level->setTrace(&trace);
+    }
+    int64_t ticks = 0;
+    result->solved = 0;
+    while(ticks < sweep.ticks) {
+        level->step();
+        ticks++;
+        if(ticks % FRAME_RATE == 0
+           && population->bestFitness() >= sweep.target) {
+            result->solved = 1;
+            break;
+        }
+    }
+    result->ticks = ticks;
+    result->seconds = statsClock() - start;
+    result->bestFitness = population->bestFitness();
+    result->offspring = population->getNumOffspring();
+    ArenaStats arena;
+    arenaStats(&arena);
+    result->heapPeak = arena.peakBytes;
+    trace.close();
+    __sync_synchronize();
+    result->status = 1;
+}
+
+/**
+ * Main loop of a worker: run jobs from its own range, then steal from the
+ * others until no jobs are left.
+ */
+static void work(int w, int numWorkers, volatile uint64_t *ranges,
+                 Sweep &sweep, std::vector<int> &order, Result *results) {
+    int job;
+    int numJobs = order.size();
+    while(true) {
+        bool found = takeFront(&ranges[w], &job);
+        for(int v = 1; !found && v < numWorkers; v++)
+            found = takeBack(&ranges[(w + v) % numWorkers], &job);
+        if(!found) return;
+        int c = order[job] / sweep.repeats;
+        Result *result = &results[order[job]];
+        pid_t pid = fork();
+        if(pid == 0) {
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, 1);
+            dup2(null, 2);
+            run(sweep, sweep.configs[c], order[job], result);
+            _exit(0);
+        }
+        int status = 0;
+        if(pid < 0 || waitpid(pid, &status, 0) < 0 || result->status != 1)
+            result->status = -1;
+        fprintf(stderr, "[%d/%d] config %d on %s: %s after %lld ticks\n",
+            job + 1, numJobs, c, sweep.configs[c].level.c_str(),
+            result->status < 0 ? "crashed"
+                : result->solved ? "solved" : "unsolved",
+            (long long) result->ticks);
+    }
+}
+
+/**
+ * Print one row per configuration, aggregating its repeats.
+ */
+static void printResults(Sweep &sweep, Result *results) {
+    printf("%-6s %-16s", "config", "level");
+    for(size_t i = 0; i < sweep.axes.size(); i++)
+        printf(" %14.14s", sweep.axes[i].name.c_str());
+    printf(" %7s %12s %10s %10s %12s %10s %8s\n", "solved", "ticks2solve",
+        "secs2solve", "ticks/s", "org-ticks/s", "best", "peak MB");
+    for(size_t c = 0; c < sweep.configs.size(); c++) {
+        Config &config = sweep.configs[c];
+        int runs = 0, solved = 0;
+        double solveTicks = 0, solveSeconds = 0, ticks = 0, seconds = 0;
+        double best = 0, peak = 0;
+        for(int r = 0; r < sweep.repeats; r++) {
+            Result &result = results[c * sweep.repeats + r];
+            if(result.status != 1) continue;
+            runs++;
+            ticks += result.ticks;
+            seconds += result.seconds;
+            best += result.bestFitness;
+            if(result.heapPeak > peak) peak = result.heapPeak;
+            if(result.solved) {
+                solved++;
+                solveTicks += result.ticks;
+                solveSeconds += result.seconds;
+            }
+        }
+        const char *slash = strrchr(config.level.c_str(), '/');
+        printf("%-6d %-16.16s", (int) c,
+            slash ? slash + 1 : config.level.c_str());
+        for(size_t i = 0; i < config.values.size(); i++)
+            printf(" %14g", config.values[i]);
+        printf(" %3d/%-3d", solved, sweep.repeats);
+        if(solved) printf(" %12.0f %10.2f", solveTicks / solved,
+                          solveSeconds / solved);
+        else printf(" %12s %10s", "-", "-");
+        double pop = NEAT::pop_size;
+        for(size_t i = 0; i < sweep.axes.size(); i++)
+            if(sweep.axes[i].name == "pop_size") pop = config.values[i];
+        if(runs) printf(" %10.0f %12.0f %10g %8.1f\n", ticks / seconds,
+                        pop * ticks / seconds, best / runs, peak / 1048576);
+        else printf(" %10s %12s %10s %8s\n", "-", "-", "-", "-");
+    }
+}
+
+int main(int argc, char **argv) {
+    int numWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *paramsFile = "data/params.ne";
+    int opt;
+    while((opt = getopt(argc, argv, "j:n:")) != -1) {
+        switch(opt) {
+        case 'j': numWorkers = atoi(optarg); break;
+        case 'n': paramsFile = optarg; break;
+        default: optind = argc + 1; break;
+        }
+    }
+    if(optind != argc - 1 || numWorkers < 1) {
+        printf("Usage: %s [-j jobs] [-n params.ne] sweepfile\n", argv[0]);
+        return 1;
+    }
+    NEAT::load_neat_params(paramsFile, false);
+    Sweep sweep;
+    if(!sweep.load(argv[optind])) return 1;
+    
+    int numJobs = sweep.configs.size() * sweep.repeats;
+    if(numWorkers > numJobs) numWorkers = numJobs;
+    std::vector<int> order(numJobs);
+    for(int i = 0; i < numJobs; i++) order[i] = i;
+    std::random_shuffle(order.begin(), order.end()); // spread slow configs
+    
+    size_t size = numWorkers * sizeof(uint64_t) + numJobs * sizeof(Result);
+    void *shared = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(shared == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(shared, 0, size);
+    volatile uint64_t *ranges = (volatile uint64_t *) shared;
+    Result *results = (Result *) (ranges + numWorkers);
+    for(int w = 0; w < numWorkers; w++) {
+        uint64_t begin = (uint64_t) numJobs * w / numWorkers;
+        uint64_t end = (uint64_t) numJobs * (w + 1) / numWorkers;
+        ranges[w] = end << 32 | begin;
+    }
+    
+    if(sweep.warmup > 0) warmUp(sweep);
+    fprintf(stderr, "%d configurations, %d runs on %d workers\n",
+        (int) sweep.configs.size(), numJobs, numWorkers);
+    fflush(stdout);
+    std::vector<pid_t> workers;
+    for(int w = 0; w < numWorkers; w++) {
+        pid_t pid = fork();
+        if(pid == 0) {
+            work(w, numWorkers, ranges, sweep, order, results);
+            _exit(0);
+        }
+        if(pid > 0) workers.push_back(pid);
+    }
+    for(size_t w = 0; w < workers.size(); w++)
+        waitpid(workers[w], NULL, 0);
+    printResults(sweep, results);
+    return 0;
+}
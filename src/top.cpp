@@ -0,0 +1,241 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+// rtneatbox-top: watch the live statistics published by one or more running
+// instances of rtneatbox (see the -s option).
+
+#include "stats.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define REFRESH_PERIOD 1 /* seconds */
+#define MAP_WIDTH 64
+#define MAP_HEIGHT 16
+
+/** A statistics file being watched */
+struct Run {
+    const char *filename;
+    StatsHeader *header;
+    size_t size;
+    /** Copy of the most recent sample */
+    std::vector<char> sample;
+    /** Tick of the most recent sample, to detect stalls */
+    int64_t lastTick;
+};
+
+/**
+ * Map the given run's statistics file, if it is not already mapped.
+ * 
+ * @param run  the run
+ * @return     true if the file is mapped and valid
+ */
+bool attach(Run *run) {
+    if(run->header) {
+        if(run->header->magic == STATS_MAGIC) return true;
+        munmap(run->header, run->size); // file was recreated
+        run->header = NULL;
+    }
+    int fd = open(run->filename, O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(StatsHeader)) {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) return false;
+    StatsHeader *header = (StatsHeader *) map;
+    if(header->magic != STATS_MAGIC || header->version != STATS_VERSION
+       || sizeof(StatsHeader) + header->numSlots * header->slotSize
+          > (size_t) st.st_size) {
+        munmap(map, st.st_size);
+        return false;
+    }
+    run->header = header;
+    run->size = st.st_size;
+    run->sample.resize(header->slotSize);
+    return true;
+}
+
+/**
+ * Copy the most recent consistent sample of the given run.
+ * 
+ * @param run  the run
+ * @return     the sample, or NULL if none is available
+ */
+StatsSample *readSample(Run *run) {
+    if(!attach(run) || run->header->head == 0) return NULL;
+    StatsSample *copy = (StatsSample *) &run->sample[0];
+    size_t size = run->header->slotSize - offsetof(StatsSlot, sample);
+    for(int tries = 0; tries < 100; tries++) {
+        uint32_t head = run->header->head;
+        __sync_synchronize();
+        StatsSlot *slot = statsSlot(run->header, head);
+        uint32_t seq = slot->seq;
+        if(seq & 1) continue; // being written
+        __sync_synchronize();
+        memcpy(copy, &slot->sample, size);
+        __sync_synchronize();
+        if(slot->seq == seq) return copy;
+    }
+    return NULL;
+}
+
+/**
+ * Return a short description of the state of the given run.
+ */
+const char *status(Run *run, StatsSample *sample) {
+    if(!sample) return "waiting";
+    if(kill(run->header->pid, 0) < 0) return "exited";
+    if(sample->tick == run->lastTick) return "stalled";
+    return "running";
+}
+
+/**
+ * Print a one-line summary of each run.
+ */
+void printSummary(std::vector<Run> &runs) {
+    printf("%-24s %-8s %10s %8s %7s %7s %7s %4s %9s %9s %6s\n",
+        "run", "state", "tick", "tick/s", "org ms", "evo ms", "phys ms",
+        "spp", "best", "mean", "thresh");
+    for(size_t i = 0; i < runs.size(); i++) {
+        Run *run = &runs[i];
+        StatsSample *s = readSample(run);
+        const char *state = status(run, s);
+        if(!s) {
+            printf("%-24.24s %-8s\n", run->filename, state);
+            continue;
+        }
+        printf("%-24.24s %-8s %10lld %8.1f %7.3f %7.3f %7.3f %4d %9.3g %9.3g "
+               "%6.2f\n", run->filename, state, (long long) s->tick,
+               s->tickRate, 1e3 * s->phaseTime[STATS_PHASE_ORGANISMS],
+               1e3 * s->phaseTime[STATS_PHASE_EVOLUTION],
+               1e3 * s->phaseTime[STATS_PHASE_PHYSICS], s->numSpecies,
+               s->bestFitness, s->meanFitness, s->compatThreshold);
+        run->lastTick = s->tick;
+    }
+}
+
+/**
+ * Print the full details of a single run, including a map of the organisms.
+ */
+void printDetail(Run *run) {
+    StatsSample *s = readSample(run);
+    const char *state = status(run, s);
+    if(!s) {
+        printf("%s: %s\n", run->filename, state);
+        return;
+    }
+    printf("%s: %s (pid %d, level %s)\n", run->filename, state,
+        run->header->pid, run->header->level);
+    printf("tick %lld, %.1f ticks/s, %d offspring\n",
+        (long long) s->tick, s->tickRate, s->numOffspring);
+    printf("per tick: organisms %.3f ms, evolution %.3f ms, "
+           "physics %.3f ms\n", 1e3 * s->phaseTime[STATS_PHASE_ORGANISMS],
+           1e3 * s->phaseTime[STATS_PHASE_EVOLUTION],
+           1e3 * s->phaseTime[STATS_PHASE_PHYSICS]);
+    printf("fitness: best %g, mean %g; compat_threshold %.2f\n",
+        s->bestFitness, s->meanFitness, s->compatThreshold);
+    if(s->terminations > 0)
+        printf("early termination: %lld evaluations, %lld ticks saved "
+               "(%.1f%%)\n", (long long) s->terminations,
+               (long long) s->savedTicks, 100.0 * s->savedTicks
+               / (s->organismTicks + s->savedTicks));
+    if(s->cachedQueries > 0)
+        printf("sensing: %lld full queries, %lld cached (%.1f%%)\n",
+            (long long) s->fullQueries, (long long) s->cachedQueries,
+            100.0 * s->cachedQueries / (s->fullQueries + s->cachedQueries));
+    if(s->activeOrganisms > 0)
+        printf("governor: %.2f ms per tick of %.2f ms, %.1f us per organism; "
+            "%d active, %d iterations, control period %d, "
+            "refresh period %d\n", 1e3 * s->tickCost, 1e3 * s->tickBudget,
+            1e6 * s->organismCost, s->activeOrganisms, s->solverIterations,
+            s->controlPeriod, s->refreshPeriod);
+    printf("memory: %.1f MB of genomes and networks (peak %.1f MB) "
+           "in %lld slabs\n", s->heapBytes / 1048576.0, s->heapPeak / 1048576.0,
+        (long long) s->heapSlabs);
+    printf("%d species\n", s->numSpecies);
+    for(int i = 0; i < s->numSpecies && i < STATS_MAX_SPECIES; i++)
+        printf("species #%d:\tsize=%3d,\taverage=%f\n",
+            s->species[i].id, s->species[i].size, s->species[i].averageEst);
+    run->lastTick = s->tick;
+    
+    int n = s->numOrganisms;
+    if(n <= 0) return;
+    float *p = statsPositions(s);
+    float minX = p[0], maxX = p[0], minY = p[1], maxY = p[1];
+    for(int i = 1; i < n; i++) {
+        if(p[2*i] < minX) minX = p[2*i];
+        if(p[2*i] > maxX) maxX = p[2*i];
+        if(p[2*i+1] < minY) minY = p[2*i+1];
+        if(p[2*i+1] > maxY) maxY = p[2*i+1];
+    }
+    char map[MAP_HEIGHT][MAP_WIDTH + 1];
+    memset(map, ' ', sizeof(map));
+    for(int i = 0; i < n; i++) {
+        int x = (int) ((MAP_WIDTH - 1) * (p[2*i] - minX)
+                       / (maxX - minX + 1e-6));
+        int y = (int) ((MAP_HEIGHT - 1) * (maxY - p[2*i+1])
+                       / (maxY - minY + 1e-6));
+        char &c = map[y][x];
+        c = (c == ' ') ? '.' : (c == '.') ? 'o' : 'O';
+    }
+    printf("organisms in [%.0f, %.0f] x [%.0f, %.0f]:\n",
+        minX, maxX, minY, maxY);
+    for(int y = 0; y < MAP_HEIGHT; y++) {
+        map[y][MAP_WIDTH] = '\0';
+        printf("|%s|\n", map[y]);
+    }
+}
+
+int main(int argc, char **argv) {
+    if(argc <= 1) {
+        printf("Usage: %s statsfile...\n", argv[0]);
+        return 1;
+    }
+    std::vector<Run> runs(argc - 1);
+    for(int i = 1; i < argc; i++) {
+        runs[i-1].filename = argv[i];
+        runs[i-1].header = NULL;
+        runs[i-1].size = 0;
+        runs[i-1].lastTick = -1;
+    }
+    while(true) {
+        printf("\033[H\033[2J");
+        if(runs.size() == 1) printDetail(&runs[0]);
+        else printSummary(runs);
+        fflush(stdout);
+        sleep(REFRESH_PERIOD);
+    }
+    return 0;
+}
@@ -0,0 +1,465 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#include "trace.h"
+#include "encoding.h"
+#include "level.h"
+#include "organism.h"
+#include "population.h"
+
+#include <cmath>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <NEAT/neat.h>
+
+/**
+ * Append a signed integer, zigzag-encoded so that small magnitudes are short.
+ */
+static void encodeSigned(int64_t value, std::string &out) {
+    encodeVarint(((uint64_t) value << 1) ^ (uint64_t) (value >> 63), out);
+}
+
+/**
+ * Read a signed integer written by encodeSigned.
+ */
+static bool decodeSigned(const char *&p, const char *end, int64_t &value) {
+    unsigned long long u;
+    if(!decodeVarint(p, end, u)) return false;
+    value = (int64_t) (u >> 1) ^ -(int64_t) (u & 1);
+    return true;
+}
+
+static int64_t quantize(double value, double quantum) {
+    return (int64_t) floor(value / quantum + 0.5);
+}
+
+Trace::Trace() : m_file(NULL), m_level(NULL), m_offset(0), m_tick(0),
+                 m_numEvents(0) {}
+
+Trace::~Trace() {
+    close();
+}
+
+/**
+ * Start tracing the given level, writing the ground and the initial state.
+ * 
+ * @param filename   the name of the file to write
+ * @param levelName  the name of the level, recorded in the header
+ * @param level      the level, whose population must already exist
+ * @return           false if the file could not be created
+ */
+bool Trace::open(const char *filename, const char *levelName, Level *level) {
+    m_file = fopen(filename, "wb");
+    if(!m_file) {
+        perror(filename);
+        return false;
+    }
+    m_level = level;
+    
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.numSlots = level->getPopulation()->getSize();
+    header.keyframePeriod = TRACE_KEYFRAME_PERIOD;
+    header.positionQuantum = TRACE_POSITION_QUANTUM;
+    header.velocityQuantum = TRACE_VELOCITY_QUANTUM;
+    strncpy(header.level, levelName, sizeof(header.level) - 1);
+    std::vector<std::vector<b2Vec2> > ground;
+    level->groundPolygons(ground);
+    header.numPolygons = ground.size();
+    m_buffer.append((const char *) &header, sizeof(header));
+    for(size_t i = 0; i < ground.size(); i++) {
+        int32_t n = ground[i].size();
+        m_buffer.append((const char *) &n, sizeof(n));
+        for(int j = 0; j < n; j++) {
+            float xy[2] = { ground[i][j].x, ground[i][j].y };
+            m_buffer.append((const char *) xy, sizeof(xy));
+        }
+    }
+    
+    Population *population = level->getPopulation();
+    m_frame.state.assign(4 * population->getSize(), 0);
+    m_frame.genomes.resize(population->getSize());
+    for(int i = 0; i < population->getSize(); i++)
+        m_frame.genomes[i] = population->getOrganism(i)
+            ->getNEATOrganism()->gnome->genome_id;
+    goal(level->getGoal());
+    m_numEvents = 0; // the first record is a keyframe anyway
+    m_events.clear();
+    m_tick = 0;
+    return true;
+}
+
+/**
+ * Finish the trace, appending the keyframe index.
+ */
+void Trace::close() {
+    if(!m_file) return;
+    if(!m_index.empty())
+        m_buffer.append((const char *) &m_index[0],
+                        m_index.size() * sizeof(TraceIndexEntry));
+    int64_t lastTick = m_tick - 1;
+    uint32_t trailer[2] = { (uint32_t) m_index.size(), TRACE_MAGIC };
+    m_buffer.append((const char *) &lastTick, sizeof(lastTick));
+    m_buffer.append((const char *) trailer, sizeof(trailer));
+    flush();
+    fclose(m_file);
+    m_file = NULL;
+}
+
+/**
+ * Record that an organism was born into the given slot.
+ * 
+ * @param slot      the slot
+ * @param genomeId  the id of the organism's genome
+ */
+void Trace::birth(int slot, int genomeId) {
+    if(!m_file) return;
+    m_events += (char) TRACE_BIRTH;
+    encodeVarint(slot, m_events);
+    encodeVarint(genomeId, m_events);
+    m_numEvents++;
+    m_frame.genomes[slot] = genomeId;
+}
+
+/**
+ * Record that the organism in the given slot died.
+ * 
+ * @param slot  the slot
+ */
+void Trace::death(int slot) {
+    if(!m_file) return;
+    m_events += (char) TRACE_DEATH;
+    encodeVarint(slot, m_events);
+    m_numEvents++;
+}
+
+/**
+ * Record that the goal moved.
+ * 
+ * @param position  the new position of the goal
+ */
+void Trace::goal(b2Vec2 position) {
+    if(!m_file) return;
+    m_frame.goal[0] = quantize(position.x, TRACE_POSITION_QUANTUM);
+    m_frame.goal[1] = quantize(position.y, TRACE_POSITION_QUANTUM);
+    m_events += (char) TRACE_GOAL;
+    encodeSigned(m_frame.goal[0], m_events);
+    encodeSigned(m_frame.goal[1], m_events);
+    m_numEvents++;
+}
+
+/**
+ * Record the state of every organism at the end of a tick.
+ */
+void Trace::tick() {
+    if(!m_file) return;
+    bool keyframe = m_tick % TRACE_KEYFRAME_PERIOD == 0;
+    if(keyframe) {
+        TraceIndexEntry entry =
+            { m_tick, m_offset + (int64_t) m_buffer.size() };
+        m_index.push_back(entry);
+    }
+    std::string record;
+    record += (char) keyframe;
+    encodeVarint(m_tick, record);
+    encodeVarint(m_numEvents, record);
+    record += m_events;
+    Population *population = m_level->getPopulation();
+    for(int i = 0; i < population->getSize(); i++) {
+        Organism *organism = population->getOrganism(i);
+        b2Vec2 p = organism->position(), v = organism->velocity();
+        int64_t values[4] = {
+            quantize(p.x, TRACE_POSITION_QUANTUM),
+            quantize(p.y, TRACE_POSITION_QUANTUM),
+            quantize(v.x, TRACE_VELOCITY_QUANTUM),
+            quantize(v.y, TRACE_VELOCITY_QUANTUM)
+        };
+        int64_t *previous = &m_frame.state[4*i];
+        for(int j = 0; j < 4; j++) {
+            encodeSigned(keyframe ? values[j] : values[j] - previous[j],
+                         record);
+            previous[j] = values[j];
+        }
+    }
+    if(keyframe) {
+        encodeSigned(m_frame.goal[0], record);
+        encodeSigned(m_frame.goal[1], record);
+        for(int i = 0; i < population->getSize(); i++)
+            encodeVarint(m_frame.genomes[i], record);
+    }
+    encodeVarint(record.size(), m_buffer);
+    m_buffer += record;
+    m_events.clear();
+    m_numEvents = 0;
+    m_tick++;
+    if(m_buffer.size() >= TRACE_BUFFER_SIZE) flush();
+}
+
+/**
+ * Write out buffered records.
+ */
+void Trace::flush() {
+    if(fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) != m_buffer.size())
+        perror("trace");
+    m_offset += m_buffer.size();
+    m_buffer.clear();
+}
+
+TraceReader::TraceReader() : m_data(NULL), m_size(0), m_lastTick(0) {}
+
+TraceReader::~TraceReader() {
+    if(m_data) munmap((void *) m_data, m_size);
+}
+
+/**
+ * Map a trace and load its index. A trace that was not closed cleanly is
+ * scanned to rebuild the index, ignoring any partly written record.
+ * 
+ * @param filename  the name of the file
+ * @return          false if the file is not a readable trace
+ */
+bool TraceReader::open(const char *filename) {
+    int fd = ::open(filename, O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) < 0) {
+        perror(filename);
+        if(fd >= 0) ::close(fd);
+        return false;
+    }
+    m_size = st.st_size;
+    void *map = m_size ? mmap(NULL, m_size, PROT_READ, MAP_SHARED, fd, 0)
+                       : MAP_FAILED;
+    ::close(fd);
+    const TraceHeader *h = (const TraceHeader *) map;
+    if(map == MAP_FAILED || m_size < sizeof(TraceHeader)
+       || h->magic != TRACE_MAGIC || h->version != TRACE_VERSION) {
+        fprintf(stderr, "%s: not a trace\n", filename);
+        if(map != MAP_FAILED) munmap(map, m_size);
+        return false;
+    }
+    m_data = (const char *) map;
+    const char *end = m_data + m_size;
+    
+    const char *p = m_data + sizeof(TraceHeader);
+    m_ground.resize(h->numPolygons);
+    for(int i = 0; i < h->numPolygons; i++) {
+        int32_t n;
+        if(p + sizeof(n) > end) return false;
+        memcpy(&n, p, sizeof(n));
+        p += sizeof(n);
+        if(n < 0 || p + n * 2 * sizeof(float) > end) return false;
+        for(int j = 0; j < n; j++) {
+            float xy[2];
+            memcpy(xy, p, sizeof(xy));
+            p += sizeof(xy);
+            m_ground[i].push_back(b2Vec2(xy[0], xy[1]));
+        }
+    }
+    m_records = p;
+    
+    uint32_t trailer[2];
+    size_t trailerSize = sizeof(trailer) + sizeof(m_lastTick);
+    if(m_size >= (size_t) (m_records - m_data) + trailerSize) {
+        memcpy(trailer, end - sizeof(trailer), sizeof(trailer));
+        size_t indexSize = trailer[0] * sizeof(TraceIndexEntry);
+        if(trailer[1] == TRACE_MAGIC
+           && (size_t) (end - m_records) >= trailerSize + indexSize) {
+            m_end = end - trailerSize - indexSize;
+            m_index.resize(trailer[0]);
+            if(indexSize) memcpy(&m_index[0], m_end, indexSize);
+            memcpy(&m_lastTick, end - trailerSize, sizeof(m_lastTick));
+        }
+    }
+    if(m_index.empty()) { // unclosed, so scan for keyframes
+        m_end = m_records;
+        for(p = m_records; p < end; ) {
+            const char *record = p;
+            unsigned long long length, tick;
+            if(!decodeVarint(p, end, length) || length > (size_t) (end - p))
+                break;
+            const char *q = p + 1;
+            if(!decodeVarint(q, p + length, tick)) break;
+            if(*p) {
+                TraceIndexEntry entry = { (int64_t) tick, record - m_data };
+                m_index.push_back(entry);
+            }
+            p += length;
+            m_end = p;
+            m_lastTick = tick;
+        }
+    }
+    if(m_index.empty()) {
+        fprintf(stderr, "%s: trace is empty\n", filename);
+        return false;
+    }
+    m_frame.state.assign(4 * h->numSlots, 0);
+    m_frame.genomes.assign(h->numSlots, 0);
+    return seek(0);
+}
+
+/**
+ * Decode the state at the given tick.
+ * 
+ * @param tick  the tick
+ * @return      false if the tick is not in the trace
+ */
+bool TraceReader::seek(int64_t tick) {
+    size_t lo = 0, hi = m_index.size(); // find the last keyframe <= tick
+    while(hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if(m_index[mid].tick <= tick) lo = mid;
+        else hi = mid;
+    }
+    if(m_index[lo].tick > tick) return false;
+    m_next = m_data + m_index[lo].offset;
+    do {
+        if(!next()) return false;
+    } while(m_frame.tick < tick);
+    return true;
+}
+
+/**
+ * Decode the next tick.
+ * 
+ * @return  false at the end of the trace
+ */
+bool TraceReader::next() {
+    const char *p = m_next;
+    if(!decode(p)) return false;
+    m_next = p;
+    return true;
+}
+
+/**
+ * Decode the record at the given position, advancing past it.
+ */
+bool TraceReader::decode(const char *&p) {
+    unsigned long long length, tick, numEvents, u;
+    if(p >= m_end || !decodeVarint(p, m_end, length)
+       || length > (size_t) (m_end - p))
+        return false;
+    const char *end = p + length;
+    bool keyframe = *p++;
+    if(!decodeVarint(p, end, tick) || !decodeVarint(p, end, numEvents))
+        return false;
+    m_frame.tick = tick;
+    m_frame.births.clear();
+    m_frame.deaths.clear();
+    int numSlots = header()->numSlots;
+    for(unsigned long long i = 0; i < numEvents && p < end; i++) {
+        unsigned long long slot;
+        switch(*p++) {
+        case TRACE_BIRTH:
+            decodeVarint(p, end, slot);
+            decodeVarint(p, end, u);
+            if((int) slot >= numSlots) return false;
+            m_frame.births.push_back(slot);
+            m_frame.genomes[slot] = u;
+            break;
+        case TRACE_DEATH:
+            decodeVarint(p, end, slot);
+            m_frame.deaths.push_back(slot);
+            break;
+        case TRACE_GOAL:
+            decodeSigned(p, end, m_frame.goal[0]);
+            decodeSigned(p, end, m_frame.goal[1]);
+            break;
+        default:
+            return false;
+        }
+    }
+    for(int i = 0; i < 4 * numSlots; i++) {
+        int64_t value;
+        if(!decodeSigned(p, end, value)) return false;
+        m_frame.state[i] = keyframe ? value : m_frame.state[i] + value;
+    }
+    if(keyframe) {
+        decodeSigned(p, end, m_frame.goal[0]);
+        decodeSigned(p, end, m_frame.goal[1]);
+        for(int i = 0; i < numSlots; i++) {
+            decodeVarint(p, end, u);
+            m_frame.genomes[i] = u;
+        }
+    }
+    p = end;
+    return true;
+}
+
+/**
+ * Return the most recently decoded state.
+ */
+const TraceFrame &TraceReader::frame() {
+    return m_frame;
+}
+
+/**
+ * Return the last tick in the trace.
+ */
+int64_t TraceReader::lastTick() {
+    return m_lastTick;
+}
+
+/**
+ * Return the header of the trace.
+ */
+const TraceHeader *TraceReader::header() {
+    return (const TraceHeader *) m_data;
+}
+
+/**
+ * Return the polygons making up the ground.
+ */
+const std::vector<std::vector<b2Vec2> > &TraceReader::ground() {
+    return m_ground;
+}
+
+/**
+ * Return the position of the organism in the given slot.
+ */
+b2Vec2 TraceReader::position(int slot) {
+    double q = header()->positionQuantum;
+    return b2Vec2(q * m_frame.state[4*slot], q * m_frame.state[4*slot + 1]);
+}
+
+/**
+ * Return the velocity of the organism in the given slot.
+ */
+b2Vec2 TraceReader::velocity(int slot) {
+    double q = header()->velocityQuantum;
+    return b2Vec2(q * m_frame.state[4*slot + 2],
+                  q * m_frame.state[4*slot + 3]);
+}
+
+/**
+ * Return the position of the goal.
+ */
+b2Vec2 TraceReader::goal() {
+    double q = header()->positionQuantum;
+    return b2Vec2(q * m_frame.goal[0], q * m_frame.goal[1]);
+}
@@ -0,0 +1,162 @@
+/*
+* Copyright (c) 2010 David Roberts <d@vidr.cc>
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <Box2D.h>
+
+#define TRACE_MAGIC 0x4352544e /* "NTRC" */
+#define TRACE_VERSION 1
+#define TRACE_KEYFRAME_PERIOD 600 /* ticks between absolute frames */
+#define TRACE_POSITION_QUANTUM (1.0/256) /* metres */
+#define TRACE_VELOCITY_QUANTUM (1.0/64) /* metres per second */
+#define TRACE_BUFFER_SIZE 65536
+
+/** Events recorded between frames */
+enum TraceEvent {
+    TRACE_BIRTH, /* slot, genome id */
+    TRACE_DEATH, /* slot */
+    TRACE_GOAL   /* quantized x, y */
+};
+
+/**
+ * The header at the start of a trace. It is followed by the ground, as a
+ * vertex count and that many (x, y) float pairs for each polygon, and then by
+ * one record per tick. A trailer of TraceIndexEntry records, their count and
+ * TRACE_MAGIC ends a trace that was closed cleanly.
+ */
+struct TraceHeader {
+    uint32_t magic;
+    uint32_t version;
+    int32_t numSlots;
+    int32_t keyframePeriod;
+    float positionQuantum;
+    float velocityQuantum;
+    int32_t numPolygons;
+    uint32_t pad;
+    char level[64];
+};
+
+/** Location of a keyframe */
+struct TraceIndexEntry {
+    int64_t tick;
+    int64_t offset;
+};
+
+/** The state of every slot at a tick, in quantized units */
+struct TraceFrame {
+    int64_t tick;
+    int64_t goal[2];
+    /** Position and velocity of each slot, four values per slot */
+    std::vector<int64_t> state;
+    std::vector<int64_t> genomes;
+    /** Slots whose organism was born or died during this tick */
+    std::vector<int> births;
+    std::vector<int> deaths;
+};
+
+class Level;
+
+/**
+ * Streams the trajectories of a level's organisms to a file. Each tick costs
+ * a few bytes per organism: positions and velocities are quantized and
+ * stored as differences from the previous tick, with an absolute keyframe
+ * every TRACE_KEYFRAME_PERIOD ticks to seek to.
+ */
+class Trace {
+public:
+    Trace();
+    ~Trace();
+    bool open(const char *filename, const char *levelName, Level *level);
+    void close();
+    void birth(int slot, int genomeId);
+    void death(int slot);
+    void goal(b2Vec2 position);
+    void tick();
+    
+protected:
+    /** The output file, or NULL if closed */
+    FILE *m_file;
+    /** The level being traced */
+    Level *m_level;
+    /** Bytes written before the buffer */
+    int64_t m_offset;
+    /** Ticks recorded */
+    int64_t m_tick;
+    /** Records not yet written */
+    std::string m_buffer;
+    /** Events of the current tick */
+    std::string m_events;
+    int m_numEvents;
+    /** The previous frame */
+    TraceFrame m_frame;
+    /** Keyframes written */
+    std::vector<TraceIndexEntry> m_index;
+    
+    void flush();
+};
+
+/**
+ * Reads a trace by mapping it into memory. Seeking decodes forward from the
+ * nearest keyframe, so needs neither the world nor the population.
+ */
+class TraceReader {
+public:
+    TraceReader();
+    ~TraceReader();
+    bool open(const char *filename);
+    bool seek(int64_t tick);
+    bool next();
+    const TraceFrame &frame();
+    int64_t lastTick();
+    const TraceHeader *header();
+    const std::vector<std::vector<b2Vec2> > &ground();
+    b2Vec2 position(int slot);
+    b2Vec2 velocity(int slot);
+    b2Vec2 goal();
+    
+protected:
+    /** The mapped file */
+    const char *m_data;
+    size_t m_size;
+    /** Start of the first record, and the end of the last */
+    const char *m_records;
+    const char *m_end;
+    /** Next record to decode */
+    const char *m_next;
+    /** Tick of the last record */
+    int64_t m_lastTick;
+    std::vector<TraceIndexEntry> m_index;
+    std::vector<std::vector<b2Vec2> > m_ground;
+    TraceFrame m_frame;
+    
+    bool decode(const char *&p);
+};
+
+#endif